@@ -29,7 +29,8 @@ MAK_LIBS=
 
 MAK_SWITCH=$(SW_PREFIX)$(DEF_REVISION)
 
-MAK_INCL=$(MEN_INC_DIR)/../../NATIVE/MEN/men_chameleon.h 
+MAK_INCL=$(MEN_INC_DIR)/../../NATIVE/MEN/men_chameleon.h \
+		 $(MEN_MOD_DIR)/fb_men_16z044_trace.h
 
 MAK_INP1=fb_men_16z044$(INP_SUFFIX)
 
@@ -6,12 +6,19 @@
  *
  *     \brief  Framebuffer driver for FPGAs containg a 16z044 unit.
  *         Supported modes:
- *         640x400 800x600 1024x768 1280x1024 at fixed 16bpp.
+ *         640x400 800x600 1024x768 1280x1024 at fixed 16bpp,
+ *         256x64 at 4bpp grayscale for small panels (panel_256x64=1),
+ *         8bpp pseudocolour and 32bpp XRGB8888 converted to RGB565 by
+ *         the shadow flush, 90/180/270 degree rotation (rotate=1..3).
  *         The driver is supposed to be used together with the
  *         men_chameleon subsystem.
  *         Requires Linux kernel >= 2.6.16
  *
- *     Switches:
+ *     Switches: MEN_16Z044_MOCK  bind to the mock chameleon device of
+ *                                fb_men_16z044_mock.ko (driver_mock.mak)
+ *               MEN_16Z044_KUNIT no chameleon driver registration, the
+ *                                file is built into the KUnit suite,
+ *                                probe only helpers are __maybe_unused
  */
 /*
  *---------------------------------------------------------------------------
@@ -40,10 +47,29 @@
 #include <linux/fb.h>
 #include <linux/console.h>
 #include <linux/selection.h>        /* default_colors    */
+#include <linux/vt_kern.h>          /* fg_console        */
+#include <linux/sched.h>            /* surface owners    */
+#include <linux/rcupdate.h>
 #include <linux/init.h>
 #include <linux/device.h>
 #include <linux/platform_device.h>
 #include <linux/delay.h>
+#include <linux/vmalloc.h>
+#include <linux/workqueue.h>
+#include <linux/spinlock.h>
+#include <linux/mutex.h>
+#include <linux/ktime.h>
+#include <linux/cpumask.h>
+#include <linux/percpu.h>
+#include <linux/debugfs.h>
+#include <linux/firmware.h>
+#include <linux/seq_file.h>
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,10,0)
+#include <linux/static_call.h>
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+#include <linux/fbcon.h>            /* fbcon_update_vcs  */
+#endif
 #include <asm/io.h>
 #if LINUX_VERSION_CODE < KERNEL_VERSION(4,12,0)
 #include <asm/uaccess.h> 			/* copy_to/from_user */
@@ -54,6 +80,15 @@
 #include <MEN/men_chameleon.h>
 #include <MEN/16z044_disp.h>
 
+#ifdef MEN_16Z044_MOCK
+/* BARs of the mock chameleon device are vmalloc'ed RAM, see MOCK/ */
+extern void *men_16z044_mock_bar(struct pci_dev *pdev, int bar,
+                                 u32 *physP, u32 *sizeP);
+#endif
+
+#define CREATE_TRACE_POINTS
+#include "fb_men_16z044_trace.h"
+
 
 /*-----------------------------+
  |  DEFINES                    |
@@ -68,16 +103,52 @@
 #define DBG_FCTNNAME
 #endif
 
+#if LINUX_VERSION_CODE < KERNEL_VERSION(4,18,0)
+#define array_size(a, b)    ((size_t)(a) * (size_t)(b))
+#endif
+
 #define FB_16Z044_COLS                 16
 #define MEN_16Z044_REFRESH_75HZ        75
 #define MEN_16Z044_REFRESH_60HZ        60
 
-/* not in 16z044_disp.h yet? */
+/* not in 16z044_disp.h yet? offsets relative to fb_men_16z044_DispCtrlBase */
+#define MEN_16Z044_DISP_CTRL           (0x00)
 #define MEN_16Z044_FP_CTRL             (0x0C)
+#define MEN_16Z044_RES_MASK            (0x3)       /* index in G_resol */
+#define MEN_16Z044_RES_HW_NUM          4           /* modes of RES_MASK */
+#define MEN_16Z044_RES_256X64          4           /* 4bpp small panel  */
+#define MEN_16Z044_LUT_CHUNK           256         /* pixels on stack   */
+#define MEN_16Z044_ROT_TW              32          /* rotation tile, px */
+#define MEN_16Z044_ROT_TH              8           /* ... SDRAM rows    */
 #define FB_IDENTIFIER                  "MEN MIKROELEKTRONIK"
 #define MEN_FB_NAME                    "fb16z044"
 #define FBDRV_NAMELEN                  32
 
+/* shadow buffer flushing */
+#define MEN_16Z044_FLUSH_DELAY         msecs_to_jiffies(16)
+#define MEN_16Z044_MAX_FLUSHERS        8
+#define MEN_16Z044_MAX_COALESCE        4           /* screens to pan   */
+#define MEN_16Z044_MAX_VT_SCREENS      8
+#define MEN_16Z044_VRAM_ALIGN          64          /* surface offsets  */
+#define MEN_16Z044_SURF_MAX            4096        /* width and height */
+#define MEN_16Z044_FLUSH_BAND_DEF      64          /* lines per band   */
+#define MEN_16Z044_FLUSH_MT_MIN_DEF    (256*1024)  /* bytes            */
+#define MEN_16Z044_FLUSH_SINGLE        0           /* index in stats   */
+#define MEN_16Z044_FLUSH_PARALLEL      1
+
+/* probe time calibration of the SDRAM access routines */
+#define MEN_16Z044_CAL_SIZE            (64*1024)   /* off-screen bytes */
+#define MEN_16Z044_CAL_LOOPS           8           /* best of          */
+#define MEN_16Z044_CAL_NUM             4           /* routines per kind */
+
+/* max. records of the debugfs access capture ring */
+#define MEN_16Z044_CAP_MAX             (1024*1024)
+
+/* refresh governor */
+#define MEN_16Z044_GOV_PERIOD_MS       100         /* sampling period  */
+#define MEN_16Z044_GOV_BURST_DEF       16          /* MB/s uploads     */
+#define MEN_16Z044_GOV_IDLE_DEF        1000        /* ms back to rate  */
+
 
 /*--------------------------------+
  |  TYPEDEFS                      |
@@ -95,12 +166,138 @@ struct PALETTE
 	u16 blue, green, red, pad;
 };
 
+/* damaged area of the shadow buffer in pixels, x2/y2 are exclusive */
+struct MEN_16Z044_RECT
+{
+	u32 x1, y1;
+	u32 x2, y2;
+};
+
+struct MEN_16Z044_FB;
+
+/* event counters, see G_statNames */
+enum MEN_16Z044_STAT
+{
+	MEN_16Z044_ST_MMIO_RD,      /* display controller register reads  */
+	MEN_16Z044_ST_MMIO_WR,      /* display controller register writes */
+	MEN_16Z044_ST_SDRAM_WR,     /* bytes written to SDRAM             */
+	MEN_16Z044_ST_SDRAM_RD,     /* bytes read back from SDRAM         */
+	MEN_16Z044_ST_REFRESH_SW,   /* refresh rate changes by governor   */
+	MEN_16Z044_ST_NUM
+};
+
+/* calls per fb_op, the first ones also have a latency histogram */
+enum MEN_16Z044_OP
+{
+	MEN_16Z044_OP_FILLRECT,
+	MEN_16Z044_OP_COPYAREA,
+	MEN_16Z044_OP_IMAGEBLIT,
+	MEN_16Z044_OP_FLUSH,
+	MEN_16Z044_OP_IOCTL,
+	MEN_16Z044_OP_LAT_NUM,
+	MEN_16Z044_OP_SETCOLREG = MEN_16Z044_OP_LAT_NUM,
+	MEN_16Z044_OP_WRITE,
+	MEN_16Z044_OP_DEFIO,
+	MEN_16Z044_OP_SETCMAP,
+	MEN_16Z044_OP_NUM
+};
+
+/* per CPU statistics, latency bucket n counts durations < 2^n ns */
+#define MEN_16Z044_LAT_BUCKETS         32
+struct MEN_16Z044_STATS
+{
+	u64 cnt[MEN_16Z044_ST_NUM];
+	u64 calls[MEN_16Z044_OP_NUM];
+	u64 lat[MEN_16Z044_OP_LAT_NUM][MEN_16Z044_LAT_BUCKETS];
+};
+
+/* refresh governor policies, see G_govNames */
+enum MEN_16Z044_GOV
+{
+	MEN_16Z044_GOV_FIXED,       /* refresh rate as set by param/ioctl */
+	MEN_16Z044_GOV_AUTO,        /* 60 Hz during upload bursts         */
+	MEN_16Z044_GOV_POWERSAVE,   /* always 60 Hz                       */
+	MEN_16Z044_GOV_NUM
+};
+
+/* one helper of the parallel flush pool */
+struct MEN_16Z044_FLUSHER
+{
+	struct work_struct work;
+	struct MEN_16Z044_FB *fbP;
+};
+
+/* off-screen SDRAM surface, see FBIO_MEN_16Z044_SURF_ALLOC */
+struct MEN_16Z044_SURF
+{
+	struct list_head list;      /* in fbP->surfs, sorted by offs */
+	u32 handle;
+	u32 offs;                   /* SDRAM byte offset */
+	u32 size;                   /* bytes incl. alignment */
+	u32 width;
+	u32 height;
+	u32 pitch;                  /* bytes per line */
+	struct pid *owner;          /* allocating process, NULL: driver */
+};
+
 /* set refresh rate (module parameter) */
 static unsigned int refresh;
 
+/* shadow buffer and flush tuning (module parameters) */
+static unsigned int shadow;
+static unsigned int flush_band    = MEN_16Z044_FLUSH_BAND_DEF;
+static unsigned int flush_workers = MEN_16Z044_MAX_FLUSHERS;
+static unsigned int flush_mt_min  = MEN_16Z044_FLUSH_MT_MIN_DEF;
+
+/* records in the access capture ring (module parameter), 0: no capture */
+static unsigned int capture;
+
+/* time the SDRAM access routines at probe (module parameter) */
+static unsigned int calibrate = 1;
+
+/* access calibration of the first instance, MB/s per G_copyFns/G_fillFns
+ * entry; the selected routines are global to the module */
+static int G_calDone;
+static u32 G_calCopy[MEN_16Z044_CAL_NUM];
+static u32 G_calFill[MEN_16Z044_CAL_NUM];
+static unsigned int G_calCopySel;
+static unsigned int G_calFillSel;
+
+/* initial refresh governor policy (module parameter) */
+static unsigned int refresh_policy = MEN_16Z044_GOV_FIXED;
+
+/* seconds without drawing until the display is blanked, 0: never */
+static unsigned int idle_blank;
+
+/* FPGA accepts resolution changes (module parameter) */
+static unsigned int modeswitch;
+
+/* 256x64 4bpp panel instead of the resolution of the control register */
+static unsigned int panel_256x64;
+
+/* bits per pixel of the fb device, 8 and 32 are converted by the shadow */
+static unsigned int depth = 16;
+
+/* FB_ROTATE_* of the screen, done by the shadow flush */
+static unsigned int rotate;
+
+/* screens fbcon scrolls over by panning, flushed once per frame */
+static unsigned int coalesce;
+
+/* VTs with an own SDRAM screen, switched by the frame offset */
+static unsigned int vt_screens;
+
+/* firmware file shown as boot splash, ms until it is hidden (0: never) */
+static char *splash;
+static unsigned int splash_ms;
+
 /* fb_ops */
 static int men_16z044_pan_display(struct fb_var_screeninfo *var,
                                   struct fb_info *info);
+static void men_16z044_Damage(struct MEN_16Z044_FB *fbP,
+                              u32 x, u32 y, u32 w, u32 h);
+static int men_16z044_AnimStop(struct MEN_16Z044_FB *fbP);
+static void men_16z044_SplashHide(struct MEN_16Z044_FB *fbP);
 
 struct MEN_16Z044_FB
 {
@@ -109,12 +306,19 @@ struct MEN_16Z044_FB
 	u16 xres_virtual;
 	u16 yres_virtual;
 
-	u16 byteswap;
-	u16 refresh_rate;
+	u16 byteswap;          /* SDRAM pixels big endian (PPC) */
+	u16 refresh_rate;      /* wanted by param/ioctl */
+	u16 hw_rate;           /* currently programmed */
+	spinlock_t ctrl_lock;  /* control register read-modify-write */
 
 	u16 line_length;
+	u16 hw_line_length;    /* bytes per line in SDRAM */
 	u16 bits_per_pixel;
 	u16 bytes_per_pixel;   /* for colors */
+	unsigned int res;      /* index in G_resol */
+	int modeswitch;        /* other modes than res may be set */
+	unsigned int rotate;     /* FB_ROTATE_* done by the flush */
+	unsigned int rotate_req; /* FB_ROTATE_* of the next set_par */
 
 	u32 sdram_phys;        /* phys mem base address (FB memory) from FPGA */
 	u32 sdram_size;        /* total size (BAR1) */
@@ -128,6 +332,12 @@ struct MEN_16Z044_FB
 	void *dispctr_virt;
 	u32 disp_offs;
 	struct PALETTE palette[FB_16Z044_COLS];
+	u32 pseudo_palette[FB_16Z044_COLS];
+	u8 lut4[FB_16Z044_COLS];  /* gray level per palette index, 4bpp */
+	u8 lut8[256];             /* lut4 applied to both pixels of a byte */
+	u16 lut16[256];           /* SDRAM pixel per palette index, 8bpp */
+	u16 lut16_next[256];      /* lut16 set by the colormap, not latched */
+	u8 lut_pending;           /* lut4/lut16_next changed, for next flush */
 	char *identifier;
 	struct fb_fix_screeninfo fix;
 	struct fb_var_screeninfo var;
@@ -141,6 +351,93 @@ struct MEN_16Z044_FB
 
 	unsigned int barSdram;
 	unsigned int barDisp;
+
+	/* system RAM shadow of the visible screen, NULL if not used */
+	u8 *shadow;
+	u32 shadow_size;
+	struct fb_deferred_io defio;
+	spinlock_t damage_lock;
+	struct MEN_16Z044_RECT damage;     /* not yet flushed to SDRAM */
+	struct delayed_work flush_work;
+	struct mutex flush_mutex;
+
+	/* console coalescing, fbcon pans over yres_virtual of the shadow */
+	unsigned int coalesce;             /* max. screens, 0 off */
+	u32 pan_yoffset;                   /* set by fb_pan_display */
+	u32 pan_foffs;                     /* FOFFS of the own screen, last
+	                                    * written by the flush */
+	u32 flush_offs;                    /* SDRAM screen the flush writes */
+
+	/* an SDRAM screen per VT, with a RAM copy of each */
+	unsigned int vt_screens;           /* 0 off */
+	unsigned int vt_slot;              /* screen of the shown VT */
+	u32 vt_valid;                      /* BIT(slot): copy matches SDRAM */
+	u8 *vt_copy;                       /* vt_screens * shadow_size */
+
+	/* off-screen SDRAM surfaces behind the screens */
+	struct mutex vram_lock;
+	struct list_head surfs;
+	u32 vram_base;                     /* first byte behind the screens */
+	u32 vram_handle;                   /* last handle given out */
+	unsigned int vram_users;           /* opens of the device file */
+
+	/* surfaces shown in turn by frame offset, under vram_lock */
+	struct delayed_work anim_work;
+	u32 *anim_handle;                  /* surfaces of the frames */
+	u32 *anim_offs;                    /* their SDRAM offsets */
+	u32 anim_count;                    /* frames, 0: not running */
+	u32 anim_next;                     /* frame shown next */
+	unsigned long anim_interval;       /* jiffies per frame */
+
+	/* boot splash in a surface, shown by frame offset */
+	u32 splash_handle;                 /* 0: not shown */
+	struct delayed_work splash_work;   /* hides it after splash_ms */
+
+	/* parallel flush of large damage in bands of rows */
+	struct workqueue_struct *flush_wq;
+	struct MEN_16Z044_FLUSHER flusher[MEN_16Z044_MAX_FLUSHERS];
+	struct MEN_16Z044_RECT flush_rect; /* rect currently flushed */
+	u32 flush_lines;                   /* band height of flush_rect */
+	u32 flush_nbands;
+	atomic_t flush_next;               /* next band to be claimed */
+	unsigned int flush_band;           /* tunables, see sysfs */
+	unsigned int flush_workers;
+	unsigned int flush_mt_min;
+
+	/* flush statistics, [MEN_16Z044_FLUSH_SINGLE/_PARALLEL] */
+	unsigned long flush_count[2];
+	u64 flush_bytes[2];
+	u64 flush_ns[2];
+
+	struct MEN_16Z044_STATS __percpu *stats;
+	struct dentry *debugfs;
+
+	/* access capture ring, see struct men_16z044_cap_rec */
+	struct men_16z044_cap_rec *cap;
+	u32 cap_size;
+	u32 cap_head;                      /* next record to write */
+	u32 cap_tail;                      /* next record to read */
+	u32 cap_lost;
+	u32 cap_on;                        /* debugfs capture_on */
+	spinlock_t cap_lock;
+
+	/* refresh governor, drops to 60 Hz while uploads are heavy */
+	struct delayed_work gov_work;
+	unsigned int refresh_policy;       /* MEN_16Z044_GOV_* */
+	unsigned int refresh_burst;        /* MB/s, tunables see sysfs */
+	unsigned int refresh_idle;         /* ms */
+	u64 gov_bytes;                     /* SDRAM_WR at last sample */
+	ktime_t gov_stamp;
+	unsigned int gov_quiet;            /* ms below burst/2 */
+
+	/* blanking, FB_BLANK_* levels */
+	spinlock_t blank_lock;
+	int blank_user;                    /* by fb_blank/ioctl */
+	int blank_hw;                      /* programmed */
+	int idle_blanked;                  /* blanked by idle timeout */
+	unsigned int idle_blank;           /* timeout in s, 0: off */
+	unsigned long idle_stamp;          /* jiffies of last drawing */
+	struct delayed_work idle_work;
 };
 
 /* currently possible resolutions (fixed into FPGA unit)*/
@@ -148,7 +445,8 @@ static const struct RES_SET G_resol[] = {
 	{  640,  480,  16 },
 	{  800,  600,  16 },
 	{ 1024,  768,  16 },
-	{ 1280, 1024,  16 }
+	{ 1280, 1024,  16 },
+	{  256,   64,   4 }     /* panel_256x64, not in RES_MASK */
 };
 
 
@@ -162,21 +460,6 @@ static unsigned int refresh = MEN_16Z044_REFRESH_60HZ;
 
 
 /* ------------------------------------------------------------------- */
-/**********************************************************************/
-/** HW panning Function, not implemented yet
- *
- * \brief  HW 'panning' might be implemented by manipulating the
- *         selected PAR_SETS timing registers. not tested yet.
- *
- * \returns -
- */
-/* TODO: currently not supported */
-static int men_16z044_pan_display(struct fb_var_screeninfo *var,
-                                  struct fb_info *info)
-{
-	return 0;
-}
-
 /**********************************************************************/
 /** provide offset address of the controll registers
  *
@@ -210,6 +493,205 @@ static void *fb_men_16z044_DispCtrlBase(struct MEN_16Z044_FB *fbP)
 	return p;
 }
 
+/**********************************************************************/
+/** add to an event counter of the calling CPU
+ *
+ * \param \IN   fbP  address of struct MEN_16Z044_FB to account
+ * \param \IN   idx  MEN_16Z044_ST_*
+ * \param \IN   n    value to add
+ */
+static inline void men_16z044_StatAdd(struct MEN_16Z044_FB *fbP,
+                                      enum MEN_16Z044_STAT idx, u64 n)
+{
+	if (fbP->stats)
+		this_cpu_add(fbP->stats->cnt[idx], n);
+}
+
+/**********************************************************************/
+/** count a call of a fb_op without a latency histogram
+ *
+ * \param \IN   fbP  address of struct MEN_16Z044_FB to account
+ * \param \IN   op   MEN_16Z044_OP_*, >= MEN_16Z044_OP_LAT_NUM
+ */
+static inline void men_16z044_StatCall(struct MEN_16Z044_FB *fbP,
+                                       enum MEN_16Z044_OP op)
+{
+	if (fbP->stats)
+		this_cpu_inc(fbP->stats->calls[op]);
+}
+
+/**********************************************************************/
+/** count a call of a fb_op and its duration
+ *
+ * \param \IN   fbP  address of struct MEN_16Z044_FB to account
+ * \param \IN   op   MEN_16Z044_OP_*, < MEN_16Z044_OP_LAT_NUM
+ * \param \IN   ns   duration in ns
+ */
+static inline void men_16z044_StatOpNs(struct MEN_16Z044_FB *fbP,
+                                       enum MEN_16Z044_OP op, s64 ns)
+{
+	if (!fbP->stats)
+		return;
+
+	this_cpu_inc(fbP->stats->calls[op]);
+	this_cpu_inc(fbP->stats->lat[op][min(fls64(ns > 0 ? ns : 0),
+	                                     MEN_16Z044_LAT_BUCKETS - 1)]);
+}
+
+/**********************************************************************/
+/** count a call of a fb_op started at t0
+ */
+static inline void men_16z044_StatOp(struct MEN_16Z044_FB *fbP,
+                                     enum MEN_16Z044_OP op, ktime_t t0)
+{
+	men_16z044_StatOpNs(fbP, op, ktime_to_ns(ktime_sub(ktime_get(), t0)));
+}
+
+/**********************************************************************/
+/** append a record to the access capture ring
+ *
+ * \brief  The oldest record is overwritten (and counted as lost) when
+ *         the ring is full.
+ *
+ * \param \IN   fbP   address of struct MEN_16Z044_FB to capture
+ * \param \IN   type  MEN_16Z044_CAP_*
+ * \param \IN   offs  register or SDRAM byte offset
+ * \param \IN   val   register value or bytes per row
+ * \param \IN   rows  rows of an SDRAM range, 1 otherwise
+ */
+static void men_16z044_Capture(struct MEN_16Z044_FB *fbP, u32 type,
+                               u32 offs, u32 val, u32 rows)
+{
+	struct men_16z044_cap_rec *rec;
+	unsigned long flags;
+
+	if (!fbP->cap || !fbP->cap_on)
+		return;
+
+	spin_lock_irqsave(&fbP->cap_lock, flags);
+	rec = &fbP->cap[fbP->cap_head];
+	rec->ns   = ktime_to_ns(ktime_get());
+	rec->type = type;
+	rec->offs = offs;
+	rec->val  = val;
+	rec->rows = rows;
+	fbP->cap_head = (fbP->cap_head + 1) % fbP->cap_size;
+	if (fbP->cap_head == fbP->cap_tail) {
+		fbP->cap_tail = (fbP->cap_tail + 1) % fbP->cap_size;
+		fbP->cap_lost++;
+	}
+	spin_unlock_irqrestore(&fbP->cap_lock, flags);
+}
+
+/**********************************************************************/
+/** bytes of a rect of w x h pixels, packed pixels rounded up
+ */
+static inline u32 men_16z044_Bytes(struct MEN_16Z044_FB *fbP, u32 w, u32 h)
+{
+	return DIV_ROUND_UP(w * fbP->bits_per_pixel, 8) * h;
+}
+
+/**********************************************************************/
+/** SDRAM bytes of a rect of w x h pixels, differs from men_16z044_Bytes()
+ *  when the shadow is expanded at flush
+ */
+static inline u32 men_16z044_HwBytes(struct MEN_16Z044_FB *fbP, u32 w, u32 h)
+{
+	return DIV_ROUND_UP(w * G_resol[fbP->res].bits_per_pixel, 8) * h;
+}
+
+/**********************************************************************/
+/** SDRAM bytes of one screen
+ */
+static inline u32 men_16z044_HwFrame(struct MEN_16Z044_FB *fbP)
+{
+	return fbP->hw_line_length * G_resol[fbP->res].yres;
+}
+
+/**********************************************************************/
+/** capture an SDRAM access to a rect of the visible screen
+ */
+static inline void men_16z044_CaptureRect(struct MEN_16Z044_FB *fbP, u32 type,
+                                          u32 x, u32 y, u32 w, u32 h)
+{
+	men_16z044_Capture(fbP, type,
+	                   y * fbP->line_length + x * fbP->bits_per_pixel / 8,
+	                   men_16z044_Bytes(fbP, w, 1), h);
+}
+
+/**********************************************************************/
+/** read a register of the display controller
+ *
+ * \param \IN   fbP  address of struct MEN_16Z044_FB to access
+ * \param \IN   reg  register offset (MEN_16Z044_DISP_CTRL, _FP_CTRL)
+ *
+ * \returns register value
+ */
+static u32 men_16z044_ReadCtrl(struct MEN_16Z044_FB *fbP, u32 reg)
+{
+	u32 val = readl(fb_men_16z044_DispCtrlBase(fbP) + reg);
+
+	men_16z044_StatAdd(fbP, MEN_16Z044_ST_MMIO_RD, 1);
+	men_16z044_Capture(fbP, MEN_16Z044_CAP_REG_RD, reg, val, 1);
+	return val;
+}
+
+/**********************************************************************/
+/** commit a value to a register of the display controller
+ *
+ * \param \IN   fbP  address of struct MEN_16Z044_FB to access
+ * \param \IN   reg  register offset (MEN_16Z044_DISP_CTRL, _FP_CTRL)
+ * \param \IN   val  value to write
+ */
+static void men_16z044_WriteCtrl(struct MEN_16Z044_FB *fbP, u32 reg, u32 val)
+{
+	trace_fb16z044_reg_write(fbP->name, reg, val);
+	men_16z044_StatAdd(fbP, MEN_16Z044_ST_MMIO_WR, 1);
+	men_16z044_Capture(fbP, MEN_16Z044_CAP_REG_WR, reg, val, 1);
+	writel(val, fb_men_16z044_DispCtrlBase(fbP) + reg);
+}
+
+/**********************************************************************/
+/** read-modify-write a register of the display controller
+ *
+ * \brief  Serialized by ctrl_lock, the refresh governor changes the
+ *         control register from a work item while ioctls and fbcon may
+ *         change other bits of it.
+ *
+ * \param \IN   fbP  address of struct MEN_16Z044_FB to access
+ * \param \IN   reg  register offset (MEN_16Z044_DISP_CTRL, _FP_CTRL)
+ * \param \IN   clr  bits to clear
+ * \param \IN   set  bits to set
+ */
+static void men_16z044_ModifyCtrl(struct MEN_16Z044_FB *fbP, u32 reg,
+                                  u32 clr, u32 set)
+{
+	unsigned long flags;
+	u32 val;
+
+	spin_lock_irqsave(&fbP->ctrl_lock, flags);
+	val = men_16z044_ReadCtrl(fbP, reg);
+	men_16z044_WriteCtrl(fbP, reg, (val & ~clr) | set);
+	spin_unlock_irqrestore(&fbP->ctrl_lock, flags);
+}
+
+/**********************************************************************/
+/** set the SDRAM byte offset of the displayed screen
+ *
+ * \brief  All writers hold flush_mutex: SET_SCREEN, the flush, mode
+ *         switches, animations and the splash.
+ *
+ * \param \IN   fbP   address of struct MEN_16Z044_FB to access
+ * \param \IN   offs  byte offset of the first pixel
+ */
+static void men_16z044_WriteFrameOffset(struct MEN_16Z044_FB *fbP, u32 offs)
+{
+	trace_fb16z044_frame_offset(fbP->name, offs);
+	men_16z044_StatAdd(fbP, MEN_16Z044_ST_MMIO_WR, 1);
+	men_16z044_Capture(fbP, MEN_16Z044_CAP_FOFFS, Z044_DISP_FOFFS, offs, 1);
+	writel(offs, fb_men_16z044_FrmOffsetReg(fbP));
+}
+
 /**********************************************************************/
 /** return the MEN_16Z044_FB struct associated with this info struct
  *
@@ -228,6 +710,79 @@ static struct MEN_16Z044_FB *men_16z044_from_info(struct fb_info *infoP)
 	return (struct MEN_16Z044_FB *)(infoP->par);
 }
 
+/**********************************************************************/
+/** RGB565 pixel of a 16 bit per channel color
+ */
+static inline u16 men_16z044_Rgb565(u32 red, u32 green, u32 blue)
+{
+	return (red & 0xf800) | ((green & 0xfc00) >> 5) | ((blue & 0xf800) >> 11);
+}
+
+/**********************************************************************/
+/** RGB565 pixel in the byte order the display controller reads, see
+ *  men_16z044_ByteSwap()
+ */
+static inline u16 men_16z044_HwPixel(struct MEN_16Z044_FB *fbP, u16 v)
+{
+	return fbP->byteswap ? (__force u16)cpu_to_be16(v) :
+	                       (__force u16)cpu_to_le16(v);
+}
+
+/**********************************************************************/
+/** number of colormap entries of the current mode
+ */
+static inline u32 men_16z044_Colors(struct MEN_16Z044_FB *fbP)
+{
+	return fbP->bits_per_pixel <= 8 ? 1 << fbP->bits_per_pixel :
+	                                  FB_16Z044_COLS;
+}
+
+/**********************************************************************/
+/** set a palette index of the 4bpp or 8bpp mode
+ *
+ * \brief  Only lut4 or lut16_next is changed, the next flush latches the
+ *         whole table. Caller holds damage_lock once the fb is registered.
+ *
+ * \param \IN  fbP    pointer to struct of 16z044 data
+ * \param \IN  regno  palette index
+ * \param \IN  red, green, blue  16 bit color of the index
+ *
+ * \returns 1 if the entry changed
+ */
+static int men_16z044_SetLut(struct MEN_16Z044_FB *fbP, unsigned int regno,
+                             u32 red, u32 green, u32 blue)
+{
+	u16 v;
+
+	if (fbP->bits_per_pixel == 4) {
+		v = (red * 77 + green * 151 + blue * 28) >> 20;
+		if (fbP->lut4[regno] == v)
+			return 0;
+		fbP->lut4[regno] = v;
+	} else {
+		v = men_16z044_Rgb565(red, green, blue);
+		if (fbP->lut16_next[regno] == v)
+			return 0;
+		fbP->lut16_next[regno] = v;
+	}
+	fbP->lut_pending = 1;
+	return 1;
+}
+
+/**********************************************************************/
+/** build the byte LUT used by the flush from the gray levels
+ *
+ * \param \IN  fbP    pointer to struct of 16z044 data
+ * \param \IN  lut4   gray level per palette index
+ */
+static void men_16z044_LatchLut(struct MEN_16Z044_FB *fbP, const u8 *lut4)
+{
+	int i;
+
+	for (i = 0; i < 256; i++)
+		fbP->lut8[i] = (lut4[i >> 4] << 4) | lut4[i & 0xf];
+}
+
 /***************************************************************************/
 /** get the framebuffers current color map.
  *
@@ -245,23 +800,102 @@ static int men_16z044_setcolreg(unsigned regno, unsigned red, unsigned green,
                                 struct fb_info *fb_info)
 {
 	struct MEN_16Z044_FB *fbP = NULL;
-
-	if (regno >= FB_16Z044_COLS)
-		return 1;
+	unsigned long flags;
+	int changed;
 
 	fbP = men_16z044_from_info(fb_info);
 	if (!fbP)
 		return -ENODEV;
 
-	fbP->palette[regno].red   = red;
-	fbP->palette[regno].green = green;
-	fbP->palette[regno].blue  = blue;
+	if (regno >= men_16z044_Colors(fbP))
+		return 1;
+
+	men_16z044_StatCall(fbP, MEN_16Z044_OP_SETCOLREG);
+	if (regno < FB_16Z044_COLS) {
+		fbP->palette[regno].red   = red;
+		fbP->palette[regno].green = green;
+		fbP->palette[regno].blue  = blue;
+	}
+
+	/* packed pixels are palette indices, translated at flush */
+	if (fbP->bits_per_pixel <= 8) {
+		spin_lock_irqsave(&fbP->damage_lock, flags);
+		changed = men_16z044_SetLut(fbP, regno, red, green, blue);
+		spin_unlock_irqrestore(&fbP->damage_lock, flags);
+		if (changed)
+			men_16z044_Damage(fbP, 0, 0, fbP->xres, fbP->yres_virtual);
+		return 0;
+	}
+
+	/* console colors of the XRGB8888 mode, converted at flush */
+	if (fbP->bits_per_pixel == 32) {
+		((u32 *)(fb_info->pseudo_palette))[regno] =
+			((red & 0xff00) << 8) | (green & 0xff00) | (blue >> 8);
+		return 0;
+	}
+
 	/* the 16z044 has just RGB565 built in for now*/
 	((u32*) (fb_info->pseudo_palette))[regno] =
-		((red   & 0xf800)      ) |
-		((green & 0xfc00) >>  5) |
-		((blue  & 0xf800) >> 11);
+		men_16z044_Rgb565(red, green, blue);
+
+	return 0;
+}
+
+/***************************************************************************/
+/** set a range of the color map in one call
+ *
+ * \brief  In the palette modes all entries are changed under damage_lock
+ *         and latched together by the next flush, which rewrites the frame
+ *         once. So a brightness or gamma step of a fade is one FBIOPUTCMAP,
+ *         not a frame written by the client, and never shown half applied.
+ *
+ * \param \IN  cmap    color map to set, transp is not used
+ * \param \IN  info    fb_info of the display
+ *
+ * \returns    0 on success or errorcode
+ */
+static int men_16z044_setcmap(struct fb_cmap *cmap, struct fb_info *info)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	unsigned long flags;
+	u32 i, regno, len;
+	int changed = 0;
+
+	if (!fbP)
+		return -ENODEV;
+
+	if (cmap->start >= men_16z044_Colors(fbP))
+		return -EINVAL;
+	len = min_t(u32, cmap->len, men_16z044_Colors(fbP) - cmap->start);
+
+	/* fbset and X send 256 entries also to truecolor (16 console colors)
+	 * and the 16 gray panel: ignore the rest like the fb core's
+	 * setcolreg loop did */
+	if (fbP->bits_per_pixel > 8) {
+		for (i = 0; i < len; i++)
+			if (men_16z044_setcolreg(cmap->start + i, cmap->red[i],
+			                         cmap->green[i], cmap->blue[i],
+			                         0, info))
+				return -EINVAL;
+		return 0;
+	}
+
+	men_16z044_StatCall(fbP, MEN_16Z044_OP_SETCMAP);
+	spin_lock_irqsave(&fbP->damage_lock, flags);
+	for (i = 0; i < len; i++) {
+		regno = cmap->start + i;
+		if (regno < FB_16Z044_COLS) {
+			fbP->palette[regno].red   = cmap->red[i];
+			fbP->palette[regno].green = cmap->green[i];
+			fbP->palette[regno].blue  = cmap->blue[i];
+		}
+		changed |= men_16z044_SetLut(fbP, regno, cmap->red[i],
+		                             cmap->green[i], cmap->blue[i]);
+	}
+	spin_unlock_irqrestore(&fbP->damage_lock, flags);
 
+	if (changed)
+		men_16z044_Damage(fbP, 0, 0, fbP->xres, fbP->yres_virtual);
 	return 0;
 }
 
@@ -283,18 +917,21 @@ static int men_16z044_SetScreen(struct MEN_16Z044_FB *fbP, unsigned int nr)
 	if (!fbP)
 		return -EINVAL;
 
-	nrScreens = (fbP->sdram_size/((fbP->xres * fbP->yres) / fbP->bytes_per_pixel));
+	/* follows the current mode */
+	nrScreens = fbP->sdram_size / men_16z044_HwFrame(fbP);
 
 	DBG_FCTNNAME;
 	DPRINTK("Nr. of Screens: %d\n", nrScreens);
 
-	if (nr > nrScreens) {
+	if (nr >= nrScreens) {
 		printk(KERN_ERR "maximum number of virtual Screens = %d\n", nrScreens);
 		return -EINVAL;
 	}
 
-	writel(nr * fbP->xres * fbP->yres * fbP->bytes_per_pixel,
-			fb_men_16z044_FrmOffsetReg(fbP));
+	/* kept until fbcon pans or a VT switch moves the own screen */
+	mutex_lock(&fbP->flush_mutex);
+	men_16z044_WriteFrameOffset(fbP, nr * men_16z044_HwFrame(fbP));
+	mutex_unlock(&fbP->flush_mutex);
 	return 0;
 }
 
@@ -321,238 +958,3191 @@ static int men_16z044_SetScreen(struct MEN_16Z044_FB *fbP, unsigned int nr)
  */
 static void men_16z044_blank(int blank, struct fb_info *info)
 {
-	unsigned int ctrl = 0;
-	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+
+	if (!fbP)
+		return;
+
+	/* bit31 must be set to '1' too to let changes take effect. */
+	men_16z044_ModifyCtrl(fbP, MEN_16Z044_DISP_CTRL, Z044_DISP_CTRL_ONOFF,
+	                      (blank ? Z044_DISP_CTRL_ONOFF : 0) |
+	                      Z044_DISP_CTRL_CHANGE);
+}
+
+/**********************************************************************/
+/** enable/disable the P018 Testpattern (a colored frame at the    edges
+ *    of the Screen, determined by the current Resolution)
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    en    1: test pattern on  0: disable it
+ *
+ * \returns  if success / negative errorcode on error
+ */
+static int men_16z044_EnableTestMode(struct MEN_16Z044_FB *fbP, unsigned int en)
+{
+	if (!fbP)
+		return -EINVAL;
+
+	if (!fbP->dispctr_virt)
+		return -EINVAL;
+
+	men_16z044_ModifyCtrl(fbP, MEN_16Z044_DISP_CTRL, Z044_DISP_CTRL_DEBUG,
+	                      en ? Z044_DISP_CTRL_DEBUG : 0);
+	return 0;
+}
+
+/**********************************************************************/
+/** Switch the refresh rate between 60 Hz and 75Hz. (currently) only
+ *  these Values are supported in the 16z044.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    rate   Value in Hz to set. currently just 60 or 75.
+ *
+ *
+ * \returns 0 if success / negative errorcode on error
+ */
+static int men_16z044_SetRefreshRate(struct MEN_16Z044_FB *fbP, unsigned int rate)
+{
+	u32 set = Z044_DISP_CTRL_CHANGE;
+
+	if (!fbP)
+		return -EINVAL;
+
+	switch (rate) {
+	case MEN_16Z044_REFRESH_75HZ:
+		DPRINTK("setting 75 Hz\n");
+		set |= Z044_DISP_CTRL_REFRESH;
+		break;
+	case MEN_16Z044_REFRESH_60HZ:
+		DPRINTK("setting 60 Hz\n");
+		break;
+	default:
+		return -EINVAL;
+	}
+	men_16z044_ModifyCtrl(fbP, MEN_16Z044_DISP_CTRL, Z044_DISP_CTRL_REFRESH,
+	                      set);
+	fbP->hw_rate = rate;
+
+	return 0;
+}
+
+/**********************************************************************/
+/**  Readout the current Resolution thats set in HW
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ *
+ * \returns (0,1,2,3) as resolution if success or negative errorcode
+ *
+ */
+static int men_16z044_GetResolution(struct MEN_16Z044_FB *fbP)
+{
+	unsigned int res = 0;
+	if (!fbP)
+		return -EINVAL;
+
+	res = men_16z044_ReadCtrl(fbP, MEN_16Z044_DISP_CTRL) &
+	      MEN_16Z044_RES_MASK;
+	printk(KERN_INFO "16Z044 found. Resolution: %d x %d\n",
+			G_resol[res].xres, G_resol[res].yres);
+	return res;
+}
+
+/**********************************************************************/
+/**  Set byte swapping of the 16bpp value according to architecture
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    en     1 to swap bytes (PPC), 0 to not swap bytes
+ *
+ * \returns 0 if success / negative errorcode on error
+ */
+static int men_16z044_ByteSwap(struct MEN_16Z044_FB *fbP, unsigned int en)
+{
+	unsigned long flags;
+
+	DPRINTK("men_16z044_ByteSwap: en = %d\n", en);
+
+	if (!fbP)
+		return -EINVAL;
+
+	men_16z044_ModifyCtrl(fbP, MEN_16Z044_DISP_CTRL, Z044_DISP_CTRL_BYTESWAP,
+	                      en ? Z044_DISP_CTRL_BYTESWAP : 0);
+
+	/* pixels converted by the flush are rewritten in the new order */
+	if (fbP->shadow &&
+	    fbP->bits_per_pixel != G_resol[fbP->res].bits_per_pixel) {
+		spin_lock_irqsave(&fbP->damage_lock, flags);
+		fbP->byteswap    = !!en;
+		fbP->lut_pending = 1;
+		spin_unlock_irqrestore(&fbP->damage_lock, flags);
+		men_16z044_Damage(fbP, 0, 0, fbP->xres, fbP->yres_virtual);
+	} else
+		fbP->byteswap = !!en;
+
+	return 0;
+
+}
+
+/**********************************************************************/
+/**  Switch flat panel on / off
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    en     0 to swap bytes, 1 to not swap bytes (PPC)
+ *
+ * \returns 0 if success / negative errorcode on error
+ */
+static int men_16z044_FlatPanel(struct MEN_16Z044_FB *fbP, unsigned int en)
+{
+	if (!fbP)
+		return -EINVAL;
+
+	men_16z044_ModifyCtrl(fbP, MEN_16Z044_FP_CTRL, 0x7, en ? 0x7 : 0);
+
+	return 0;
+}
+
+/**********************************************************************/
+/** program the blank level wanted by the user and the idle timeout
+ *
+ * \brief  FB_BLANK_NORMAL stops the scanout (ONOFF), the higher levels
+ *         also switch the flat panel off. Idle blanking uses
+ *         FB_BLANK_POWERDOWN. Leaving a blank level kicks the flush of
+ *         the damage parked meanwhile. Called with blank_lock held.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void men_16z044_ApplyBlank(struct MEN_16Z044_FB *fbP)
+{
+	int level = fbP->idle_blanked ? FB_BLANK_POWERDOWN : fbP->blank_user;
+
+	if (level == fbP->blank_hw)
+		return;
+
+	if ((level > FB_BLANK_NORMAL) != (fbP->blank_hw > FB_BLANK_NORMAL))
+		men_16z044_FlatPanel(fbP, level <= FB_BLANK_NORMAL);
+	if (!level != !fbP->blank_hw)
+		men_16z044_blank(level, &fbP->info);
+	WRITE_ONCE(fbP->blank_hw, level);
+
+	if (level == FB_BLANK_UNBLANK && fbP->shadow)
+		schedule_delayed_work(&fbP->flush_work, 0);
+}
+
+/**********************************************************************/
+/** idle timeout, blank the display when nothing was drawn for idle_blank s
+ *
+ * \param \IN    work   work_struct embedded in fbP->idle_work
+ */
+static void men_16z044_IdleWork(struct work_struct *work)
+{
+	struct MEN_16Z044_FB *fbP =
+		container_of(work, struct MEN_16Z044_FB, idle_work.work);
+	unsigned long flags, now = jiffies, due;
+
+	if (!fbP->idle_blank)
+		return;
+
+	spin_lock_irqsave(&fbP->blank_lock, flags);
+	if (!fbP->idle_blanked) {
+		/* pairs with the barrier in men_16z044_Activity() */
+		fbP->idle_blanked = 1;
+		smp_mb();
+		due = READ_ONCE(fbP->idle_stamp) + fbP->idle_blank * HZ;
+		if (time_before(now, due)) {
+			fbP->idle_blanked = 0;
+			spin_unlock_irqrestore(&fbP->blank_lock, flags);
+			schedule_delayed_work(&fbP->idle_work, due - now);
+			return;
+		}
+		men_16z044_ApplyBlank(fbP);
+	}
+	spin_unlock_irqrestore(&fbP->blank_lock, flags);
+}
+
+/**********************************************************************/
+/** unblank after an idle blank, restart the idle timeout
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void men_16z044_IdleWake(struct MEN_16Z044_FB *fbP)
+{
+	unsigned long flags;
+	int woke = 0;
+
+	spin_lock_irqsave(&fbP->blank_lock, flags);
+	if (fbP->idle_blanked) {
+		fbP->idle_blanked = 0;
+		men_16z044_ApplyBlank(fbP);
+		woke = 1;
+	}
+	spin_unlock_irqrestore(&fbP->blank_lock, flags);
+
+	if (woke && fbP->idle_blank)
+		schedule_delayed_work(&fbP->idle_work, fbP->idle_blank * HZ);
+}
+
+/**********************************************************************/
+/** note drawing activity for the idle timeout
+ *
+ * \brief  Cheap unless the display is idle blanked, then it is unblanked
+ *         at once. May be called from atomic context.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static inline void men_16z044_Activity(struct MEN_16Z044_FB *fbP)
+{
+	if (!fbP->idle_blank)
+		return;
+
+	WRITE_ONCE(fbP->idle_stamp, jiffies);
+	smp_mb();
+	if (unlikely(READ_ONCE(fbP->idle_blanked)))
+		men_16z044_IdleWake(fbP);
+}
+
+/**********************************************************************/
+/** fb_blank, console blanking and FBIOBLANK
+ *
+ * \param \IN    blank  FB_BLANK_* level
+ * \param \IN    info   fb_info of the display
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_fb_blank(int blank, struct fb_info *info)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	unsigned long flags;
+
+	if (!fbP)
+		return -ENODEV;
+	if (blank < FB_BLANK_UNBLANK || blank > FB_BLANK_POWERDOWN)
+		return -EINVAL;
+
+	spin_lock_irqsave(&fbP->blank_lock, flags);
+	fbP->blank_user = blank;
+	/* an explicit unblank also ends an idle blank */
+	if (blank == FB_BLANK_UNBLANK)
+		fbP->idle_blanked = 0;
+	men_16z044_ApplyBlank(fbP);
+	spin_unlock_irqrestore(&fbP->blank_lock, flags);
+
+	if (blank == FB_BLANK_UNBLANK && fbP->idle_blank) {
+		WRITE_ONCE(fbP->idle_stamp, jiffies);
+		mod_delayed_work(system_wq, &fbP->idle_work,
+		                 fbP->idle_blank * HZ);
+	}
+	return 0;
+}
+
+/*-----------------------------------------------------------------------+
+ |  SDRAM access routines, the fastest ones are selected at probe        |
+ +-----------------------------------------------------------------------*/
+/* copy routines, dst and src have the same alignment, len is even */
+static void men_16z044_Copy16(void __iomem *dst, const void *src, size_t len)
+{
+	for (; len >= 2; dst += 2, src += 2, len -= 2)
+		__raw_writew(*(const u16 *)src, dst);
+}
+
+static void men_16z044_Copy32(void __iomem *dst, const void *src, size_t len)
+{
+	if (len >= 2 && ((unsigned long)dst & 2)) {
+		__raw_writew(*(const u16 *)src, dst);
+		dst += 2; src += 2; len -= 2;
+	}
+	for (; len >= 4; dst += 4, src += 4, len -= 4)
+		__raw_writel(*(const u32 *)src, dst);
+	men_16z044_Copy16(dst, src, len);
+}
+
+static void men_16z044_Copy64(void __iomem *dst, const void *src, size_t len)
+{
+#ifdef CONFIG_64BIT
+	for (; len >= 2 && ((unsigned long)dst & 7); dst += 2, src += 2, len -= 2)
+		__raw_writew(*(const u16 *)src, dst);
+	for (; len >= 8; dst += 8, src += 8, len -= 8)
+		__raw_writeq(*(const u64 *)src, dst);
+#endif
+	men_16z044_Copy16(dst, src, len);
+}
+
+static void men_16z044_CopyMemcpy(void __iomem *dst, const void *src,
+                                  size_t len)
+{
+	memcpy_toio(dst, src, len);
+}
+
+/* fill routines, len bytes of 16bpp pixels */
+static void men_16z044_Fill16(void __iomem *dst, u16 pixel, size_t len)
+{
+	for (; len >= 2; dst += 2, len -= 2)
+		__raw_writew(pixel, dst);
+}
+
+static void men_16z044_Fill32(void __iomem *dst, u16 pixel, size_t len)
+{
+	u32 val = pixel | ((u32)pixel << 16);
+
+	if (len >= 2 && ((unsigned long)dst & 2)) {
+		__raw_writew(pixel, dst);
+		dst += 2; len -= 2;
+	}
+	for (; len >= 4; dst += 4, len -= 4)
+		__raw_writel(val, dst);
+	men_16z044_Fill16(dst, pixel, len);
+}
+
+static void men_16z044_Fill64(void __iomem *dst, u16 pixel, size_t len)
+{
+#ifdef CONFIG_64BIT
+	u64 val = pixel * 0x0001000100010001ULL;
+
+	for (; len >= 2 && ((unsigned long)dst & 7); dst += 2, len -= 2)
+		__raw_writew(pixel, dst);
+	for (; len >= 8; dst += 8, len -= 8)
+		__raw_writeq(val, dst);
+#endif
+	men_16z044_Fill16(dst, pixel, len);
+}
+
+static void men_16z044_FillMemset(void __iomem *dst, u16 pixel, size_t len)
+{
+	/* memset_io repeats one byte, other colours need pixel stores */
+	if ((pixel >> 8) == (pixel & 0xff))
+		memset_io(dst, pixel & 0xff, len);
+	else
+		men_16z044_Fill32(dst, pixel, len);
+}
+
+/* candidates of the calibration, [0] is the default */
+static const struct {
+	const char *name;
+	void (*fn)(void __iomem *dst, const void *src, size_t len);
+	int avail;
+} G_copyFns[MEN_16Z044_CAL_NUM] = {
+	{ "memcpy_toio", men_16z044_CopyMemcpy, 1 },
+	{ "copy16",      men_16z044_Copy16,     1 },
+	{ "copy32",      men_16z044_Copy32,     1 },
+	{ "copy64",      men_16z044_Copy64,     IS_ENABLED(CONFIG_64BIT) },
+};
+
+static const struct {
+	const char *name;
+	void (*fn)(void __iomem *dst, u16 pixel, size_t len);
+	int avail;
+} G_fillFns[MEN_16Z044_CAL_NUM] = {
+	{ "fill32",      men_16z044_Fill32,     1 },
+	{ "fill16",      men_16z044_Fill16,     1 },
+	{ "fill64",      men_16z044_Fill64,     IS_ENABLED(CONFIG_64BIT) },
+	{ "memset_io",   men_16z044_FillMemset, 1 },
+};
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,10,0)
+DEFINE_STATIC_CALL(men_16z044_copy, men_16z044_CopyMemcpy);
+DEFINE_STATIC_CALL(men_16z044_fill, men_16z044_Fill32);
+#define MEN_16Z044_COPY(d, s, l)    static_call(men_16z044_copy)(d, s, l)
+#define MEN_16Z044_FILL(d, p, l)    static_call(men_16z044_fill)(d, p, l)
+#define MEN_16Z044_SET_COPY(fn)     static_call_update(men_16z044_copy, fn)
+#define MEN_16Z044_SET_FILL(fn)     static_call_update(men_16z044_fill, fn)
+#else
+static void (*G_copyFn)(void __iomem *, const void *, size_t) =
+	men_16z044_CopyMemcpy;
+static void (*G_fillFn)(void __iomem *, u16, size_t) = men_16z044_Fill32;
+#define MEN_16Z044_COPY(d, s, l)    G_copyFn(d, s, l)
+#define MEN_16Z044_FILL(d, p, l)    G_fillFn(d, p, l)
+#define MEN_16Z044_SET_COPY(fn)     (G_copyFn = (fn))
+#define MEN_16Z044_SET_FILL(fn)     (G_fillFn = (fn))
+#endif
+
+/**********************************************************************/
+/** MB/s of bytes written in ns
+ */
+static u32 men_16z044_CalMBs(u64 bytes, s64 ns)
+{
+	return ns > 0 ? (u32)div64_u64(bytes * 1000, ns) : 0;
+}
+
+/**********************************************************************/
+/** time the SDRAM access routines and select the fastest ones
+ *
+ * \brief  Every copy and fill candidate writes MEN_16Z044_CAL_SIZE bytes
+ *         behind the visible screen, the best of MEN_16Z044_CAL_LOOPS runs
+ *         counts. A read back after each run makes sure the posted writes
+ *         reached the SDRAM. Fills are timed with black, the colour of
+ *         console clears. The selection is global to the module, so only
+ *         the first instance is timed and the others use its result.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void __maybe_unused men_16z044_Calibrate(struct MEN_16Z044_FB *fbP)
+{
+	u32 offs = PAGE_ALIGN(men_16z044_HwFrame(fbP));
+	void __iomem *area = fbP->sdram_virt + offs;
+	unsigned int i, loop;
+	s64 ns, best;
+	ktime_t t0;
+	void *src;
+
+	if (!calibrate || G_calDone)
+		return;
+	if (offs + MEN_16Z044_CAL_SIZE > fbP->sdram_size) {
+		printk(KERN_INFO "%s: no off-screen memory, access routines "
+		       "not calibrated\n", fbP->name);
+		return;
+	}
+	src = kmalloc(MEN_16Z044_CAL_SIZE, GFP_KERNEL);
+	if (!src)
+		return;
+	memset(src, 0x5a, MEN_16Z044_CAL_SIZE);
+
+	for (i = 0; i < MEN_16Z044_CAL_NUM; i++) {
+		if (!G_copyFns[i].avail)
+			continue;
+		best = S64_MAX;
+		for (loop = 0; loop < MEN_16Z044_CAL_LOOPS; loop++) {
+			t0 = ktime_get();
+			G_copyFns[i].fn(area, src, MEN_16Z044_CAL_SIZE);
+			wmb();
+			(void)readl(area);
+			ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+			best = min(best, ns);
+		}
+		G_calCopy[i] = men_16z044_CalMBs(MEN_16Z044_CAL_SIZE, best);
+		if (G_calCopy[i] > G_calCopy[G_calCopySel])
+			G_calCopySel = i;
+	}
+
+	for (i = 0; i < MEN_16Z044_CAL_NUM; i++) {
+		if (!G_fillFns[i].avail)
+			continue;
+		best = S64_MAX;
+		for (loop = 0; loop < MEN_16Z044_CAL_LOOPS; loop++) {
+			t0 = ktime_get();
+			G_fillFns[i].fn(area, 0, MEN_16Z044_CAL_SIZE);
+			wmb();
+			(void)readl(area);
+			ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+			best = min(best, ns);
+		}
+		G_calFill[i] = men_16z044_CalMBs(MEN_16Z044_CAL_SIZE, best);
+		if (G_calFill[i] > G_calFill[G_calFillSel])
+			G_calFillSel = i;
+	}
+	kfree(src);
+
+	MEN_16Z044_SET_COPY(G_copyFns[G_calCopySel].fn);
+	MEN_16Z044_SET_FILL(G_fillFns[G_calFillSel].fn);
+	G_calDone = 1;
+
+	printk(KERN_INFO "%s: copy with %s (%u MB/s), fill with %s (%u MB/s)\n",
+	       fbP->name, G_copyFns[G_calCopySel].name,
+	       G_calCopy[G_calCopySel],
+	       G_fillFns[G_calFillSel].name,
+	       G_calFill[G_calFillSel]);
+}
+
+/**********************************************************************/
+/** solid fill of a rect directly in SDRAM
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    rect   rect to fill, ROP_COPY
+ */
+static void men_16z044_FillIo(struct MEN_16Z044_FB *fbP,
+                              const struct fb_fillrect *rect)
+{
+	u16 pixel = ((u32 *)fbP->info.pseudo_palette)[rect->color];
+	void __iomem *dst = fbP->info.screen_base + rect->dy * fbP->line_length +
+	                    rect->dx * fbP->bytes_per_pixel;
+	size_t len = rect->width * fbP->bytes_per_pixel;
+	u32 y;
+
+	if (len == fbP->line_length) {
+		MEN_16Z044_FILL(dst, pixel, len * rect->height);
+		return;
+	}
+	for (y = 0; y < rect->height; y++, dst += fbP->line_length)
+		MEN_16Z044_FILL(dst, pixel, len);
+}
+
+/**********************************************************************/
+/** convert XRGB8888 pixels to RGB565 in SDRAM byte order
+ *
+ * \brief  Two pixels are converted per step in one 64 bit word, the
+ *         shifts and masks work on both halves at once.
+ *
+ * \param \IN    dst    RGB565 pixels, 4 byte aligned
+ * \param \IN    src    XRGB8888 pixels
+ * \param \IN    n      number of pixels
+ * \param \IN    swap   big endian output, see men_16z044_HwPixel()
+ */
+static void men_16z044_Xrgb565(u16 *dst, const u32 *src, u32 n, int swap)
+{
+	u32 *d = (u32 *)dst;
+	u64 p;
+	u32 i, w;
+
+	for (i = 0; i + 1 < n; i += 2) {
+		p = src[i] | (u64)src[i + 1] << 32;
+		p = ((p >> 8) & 0x0000f8000000f800ULL) |
+		    ((p >> 5) & 0x000007e0000007e0ULL) |
+		    ((p >> 3) & 0x0000001f0000001fULL);
+		w = (u32)p | (u32)(p >> 16);
+		if (swap)
+			w = ((w & 0x00ff00ff) << 8) | ((w >> 8) & 0x00ff00ff);
+		*d++ = (__force u32)cpu_to_le32(w);
+	}
+	if (i < n) {
+		w = src[i];
+		w = ((w >> 8) & 0xf800) | ((w >> 5) & 0x07e0) | ((w >> 3) & 0x1f);
+		dst[i] = swap ? (__force u16)cpu_to_be16(w) :
+		                (__force u16)cpu_to_le16(w);
+	}
+}
+
+/**********************************************************************/
+/** write rows of the flushed rect rotated into SDRAM
+ *
+ * \brief  The rect in SDRAM is walked in tiles of ROT_TW x ROT_TH pixels.
+ *         A tile is gathered from ROT_TW shadow lines which stay cached
+ *         while it is read, then each tile row is written as one run of
+ *         ROT_TW pixels. The cost follows the damage, not the glyphs.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    src    shadow or the copy of a VT screen to write from
+ * \param \IN    r      rect being flushed, in shadow coordinates
+ * \param \IN    y1     first row to copy
+ * \param \IN    y2     row after the last row to copy
+ */
+static void men_16z044_FlushRot(struct MEN_16Z044_FB *fbP, const u8 *src8,
+                                const struct MEN_16Z044_RECT *r,
+                                u32 y1, u32 y2)
+{
+	u16 tile[MEN_16Z044_ROT_TH][MEN_16Z044_ROT_TW];
+	const u16 *src = (const u16 *)src8, *p;
+	void *vram = fbP->sdram_virt + fbP->flush_offs;
+	long s = fbP->line_length / 2, base, dx, dy;
+	u32 w = fbP->xres, h = fbP->yres;
+	u32 X1, X2, Y1, Y2, X, Y, tx, ty, tw, th;
+
+	/* SDRAM rect and shadow pixel of SDRAM pixel (X, Y):
+	 * src[base + X * dx + Y * dy] */
+	switch (fbP->rotate) {
+	case FB_ROTATE_CW:
+		X1 = h - y2;     X2 = h - y1;
+		Y1 = r->x1;      Y2 = r->x2;
+		base = (h - 1) * s;          dx = -s; dy = 1;
+		break;
+	case FB_ROTATE_UD:
+		X1 = w - r->x2;  X2 = w - r->x1;
+		Y1 = h - y2;     Y2 = h - y1;
+		base = (h - 1) * s + w - 1;  dx = -1; dy = -s;
+		break;
+	default: /* FB_ROTATE_CCW */
+		X1 = y1;         X2 = y2;
+		Y1 = w - r->x2;  Y2 = w - r->x1;
+		base = w - 1;                dx = s;  dy = -1;
+		break;
+	}
+
+	men_16z044_Capture(fbP, MEN_16Z044_CAP_SDRAM_WR,
+	                   fbP->flush_offs + Y1 * fbP->hw_line_length + X1 * 2,
+	                   (X2 - X1) * 2, Y2 - Y1);
+
+	for (Y = Y1; Y < Y2; Y += th) {
+		th = min_t(u32, Y2 - Y, MEN_16Z044_ROT_TH);
+		for (X = X1; X < X2; X += tw) {
+			tw = min_t(u32, X2 - X, MEN_16Z044_ROT_TW);
+			for (ty = 0; ty < th; ty++) {
+				p = src + base + (long)X * dx +
+				    (long)(Y + ty) * dy;
+				for (tx = 0; tx < tw; tx++, p += dx)
+					tile[ty][tx] = *p;
+			}
+			for (ty = 0; ty < th; ty++)
+				MEN_16Z044_COPY(vram +
+				                (Y + ty) * fbP->hw_line_length +
+				                X * 2, tile[ty], tw * 2);
+		}
+	}
+}
+
+/**********************************************************************/
+/** write rows of the flushed rect into the SDRAM screen at flush_offs
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    src    shadow or the copy of a VT screen to write from
+ * \param \IN    r      rect being flushed
+ * \param \IN    y1     first row to copy
+ * \param \IN    y2     row after the last row to copy
+ */
+static void men_16z044_WriteRows(struct MEN_16Z044_FB *fbP, const u8 *src,
+                                 const struct MEN_16Z044_RECT *r,
+                                 u32 y1, u32 y2)
+{
+	void *vram = fbP->sdram_virt + fbP->flush_offs;
+	u32 offs = y1 * fbP->line_length + r->x1 * fbP->bits_per_pixel / 8;
+	u32 len  = men_16z044_Bytes(fbP, r->x2 - r->x1, 1);
+	u16 buf[MEN_16Z044_LUT_CHUNK] __aligned(4);
+	u8 *b = (u8 *)buf;
+	u32 i, j, n, hw, w = r->x2 - r->x1;
+
+	if (fbP->rotate) {
+		men_16z044_FlushRot(fbP, src, r, y1, y2);
+		return;
+	}
+
+	hw = fbP->flush_offs + y1 * fbP->hw_line_length +
+	     men_16z044_HwBytes(fbP, r->x1, 1);
+	men_16z044_Capture(fbP, MEN_16Z044_CAP_SDRAM_WR, hw,
+	                   men_16z044_HwBytes(fbP, r->x2 - r->x1, 1), y2 - y1);
+
+	/* 4bpp palette indices are written as gray levels */
+	if (fbP->bits_per_pixel == 4) {
+		for (; y1 < y2; y1++, offs += fbP->line_length) {
+			for (i = 0; i < len; i += n) {
+				n = min_t(u32, len - i, sizeof(buf));
+				for (j = 0; j < n; j++)
+					b[j] = fbP->lut8[src[offs + i + j]];
+				MEN_16Z044_COPY(vram + offs + i, b, n);
+			}
+		}
+		return;
+	}
+
+	/* 8bpp palette indices are expanded to RGB565 */
+	if (fbP->bits_per_pixel == 8) {
+		for (; y1 < y2; y1++, offs += fbP->line_length,
+		     hw += fbP->hw_line_length) {
+			for (i = 0; i < len; i += n) {
+				n = min_t(u32, len - i, ARRAY_SIZE(buf));
+				for (j = 0; j < n; j++)
+					buf[j] = fbP->lut16[src[offs + i + j]];
+				MEN_16Z044_COPY(vram + hw + 2 * i, buf,
+				                2 * n);
+			}
+		}
+		return;
+	}
+
+	/* XRGB8888 is converted to RGB565, damage only */
+	if (fbP->bits_per_pixel == 32) {
+		for (; y1 < y2; y1++, offs += fbP->line_length,
+		     hw += fbP->hw_line_length) {
+			for (i = 0; i < w; i += n) {
+				n = min_t(u32, w - i, ARRAY_SIZE(buf));
+				men_16z044_Xrgb565(buf,
+				                   (const u32 *)(src + offs) + i,
+				                   n, fbP->byteswap);
+				MEN_16Z044_COPY(vram + hw + 2 * i, buf,
+				                2 * n);
+			}
+		}
+		return;
+	}
+
+	/* full lines are contiguous in shadow and SDRAM, copy them at once */
+	if (len == fbP->line_length) {
+		MEN_16Z044_COPY(vram + offs, src + offs, (y2 - y1) * len);
+		return;
+	}
+
+	for (; y1 < y2; y1++, offs += fbP->line_length)
+		MEN_16Z044_COPY(vram + offs, src + offs, len);
+}
+
+/**********************************************************************/
+/** copy rows of the flushed rect from the shadow buffer into SDRAM
+ *
+ * \brief  With vt_screens each VT has its own SDRAM screen and a RAM copy
+ *         of what that screen holds. Rows equal to the copy are skipped,
+ *         changed runs are taken into the copy and written from there, so
+ *         the SDRAM always shows what the copy says. The fbcon redraw of
+ *         a VT switch then costs compares instead of PCI writes.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    r      rect being flushed
+ * \param \IN    y1     first row to copy
+ * \param \IN    y2     row after the last row to copy
+ */
+static void men_16z044_FlushRows(struct MEN_16Z044_FB *fbP,
+                                 const struct MEN_16Z044_RECT *r,
+                                 u32 y1, u32 y2)
+{
+	u32 x = r->x1 * fbP->bits_per_pixel / 8;
+	u32 len = men_16z044_Bytes(fbP, r->x2 - r->x1, 1);
+	int valid = fbP->vt_valid & BIT(fbP->vt_slot);
+	u8 *copy;
+	u32 y, o;
+
+	if (!fbP->vt_copy) {
+		men_16z044_WriteRows(fbP, fbP->shadow, r, y1, y2);
+		return;
+	}
+
+	copy = fbP->vt_copy + fbP->vt_slot * fbP->shadow_size;
+	while (y1 < y2) {
+		for (; y1 < y2; y1++) {
+			o = y1 * fbP->line_length + x;
+			if (!valid || memcmp(copy + o, fbP->shadow + o, len))
+				break;
+		}
+		for (y = y1; y < y2; y++) {
+			o = y * fbP->line_length + x;
+			if (valid && !memcmp(copy + o, fbP->shadow + o, len))
+				break;
+			memcpy(copy + o, fbP->shadow + o, len);
+		}
+		if (y > y1)
+			men_16z044_WriteRows(fbP, copy, r, y1, y);
+		y1 = y;
+	}
+}
+
+/**********************************************************************/
+/** claim and copy bands of flush_rect until none is left
+ *
+ * \brief  Called by the flush leader and all helpers of the pool, each
+ *         band is copied by exactly one of them.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void men_16z044_FlushBands(struct MEN_16Z044_FB *fbP)
+{
+	const struct MEN_16Z044_RECT *r = &fbP->flush_rect;
+	u32 band, y1;
+
+	while ((band = atomic_inc_return(&fbP->flush_next) - 1) <
+	       fbP->flush_nbands) {
+		y1 = r->y1 + band * fbP->flush_lines;
+		men_16z044_FlushRows(fbP, r, y1,
+		                     min(y1 + fbP->flush_lines, r->y2));
+	}
+}
+
+/**********************************************************************/
+/** work function of a flush pool helper
+ *
+ * \param \IN    work   work_struct embedded in struct MEN_16Z044_FLUSHER
+ */
+static void men_16z044_FlushHelper(struct work_struct *work)
+{
+	struct MEN_16Z044_FLUSHER *flP =
+		container_of(work, struct MEN_16Z044_FLUSHER, work);
+
+	men_16z044_FlushBands(flP->fbP);
+}
+
+/**********************************************************************/
+/** frame offset of the fb device's own screen
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ *
+ * \returns the byte offset the flush would write to FOFFS
+ */
+static u32 men_16z044_ScreenOffs(struct MEN_16Z044_FB *fbP)
+{
+	return READ_ONCE(fbP->pan_yoffset) * fbP->hw_line_length +
+	       fbP->flush_offs;
+}
+
+/**********************************************************************/
+/** SDRAM screen of the foreground VT
+ *
+ * \brief  The first VTs get screens 0..n-1, the others share the last
+ *         one and are redrawn on a switch like without vt_screens. n is
+ *         what fits into SDRAM in the current mode.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ *
+ * \returns index of the screen
+ */
+static unsigned int men_16z044_VtSlot(struct MEN_16Z044_FB *fbP)
+{
+#ifdef CONFIG_VT
+	unsigned int n = min_t(unsigned int, fbP->vt_screens,
+	                       fbP->sdram_size / men_16z044_HwFrame(fbP));
+
+	return min_t(unsigned int, READ_ONCE(fg_console), n - 1);
+#else
+	return 0;
+#endif
+}
+
+/**********************************************************************/
+/** write the damaged area of the shadow buffer to SDRAM
+ *
+ * \brief  Small damage is copied by the caller alone. Damage of at least
+ *         flush_mt_min bytes is split into bands of flush_band rows which
+ *         are copied concurrently by the caller and up to flush_workers-1
+ *         helpers queued on other online CPUs, so the posted writes of
+ *         several CPUs are in flight on the PCI link at once.
+ *         The net fbcon panning since the last flush and VT switches
+ *         follow as a single frame offset write once the rows are in
+ *         SDRAM.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void men_16z044_Flush(struct MEN_16Z044_FB *fbP)
+{
+	struct MEN_16Z044_RECT r;
+	unsigned long flags;
+	unsigned int lines, nbands, nhelpers, i = 0, cpu, self;
+	u8 lut4[FB_16Z044_COLS];
+	int lut = 0, j;
+	u32 bytes, foffs;
+	unsigned int slot;
+	int mode = MEN_16Z044_FLUSH_SINGLE;
+	ktime_t t0;
+	s64 ns;
+
+	mutex_lock(&fbP->flush_mutex);
+
+	/* parked while blanked, the damage is kept for the unblank */
+	if (READ_ONCE(fbP->blank_hw) != FB_BLANK_UNBLANK)
+		goto out;
+
+	/* a colormap is latched together with the damage it caused */
+	spin_lock_irqsave(&fbP->damage_lock, flags);
+	r = fbP->damage;
+	fbP->damage.x2 = fbP->damage.y2 = 0;
+	if (fbP->lut_pending) {
+		memcpy(lut4, fbP->lut4, sizeof(lut4));
+		for (j = 0; j < ARRAY_SIZE(fbP->lut16); j++)
+			fbP->lut16[j] = men_16z044_HwPixel(fbP,
+			                                   fbP->lut16_next[j]);
+		fbP->lut_pending = 0;
+		lut = 1;
+	}
+	spin_unlock_irqrestore(&fbP->damage_lock, flags);
+
+	if (lut) {
+		men_16z044_LatchLut(fbP, lut4);
+		/* the VT screens hold the old colors */
+		fbP->vt_valid = 0;
+	}
+
+	/* VT switch, bring the screen of the new VT up to date */
+	if (fbP->vt_copy) {
+		slot = men_16z044_VtSlot(fbP);
+		if (slot != fbP->vt_slot || !(fbP->vt_valid & BIT(slot))) {
+			fbP->vt_slot    = slot;
+			fbP->flush_offs = slot * men_16z044_HwFrame(fbP);
+			r.x1 = r.y1 = 0;
+			r.x2 = fbP->xres;
+			r.y2 = fbP->yres;
+		}
+	}
+
+	if (r.x1 >= r.x2 || r.y1 >= r.y2)
+		goto pan;
+
+	bytes  = men_16z044_HwBytes(fbP, r.x2 - r.x1, r.y2 - r.y1);
+	lines  = fbP->flush_band ? fbP->flush_band : r.y2 - r.y1;
+	nbands = DIV_ROUND_UP(r.y2 - r.y1, lines);
+	nhelpers = min3(fbP->flush_workers, num_online_cpus(), nbands);
+	nhelpers = nhelpers ? nhelpers - 1 : 0;
+
+	t0 = ktime_get();
+	if (!fbP->flush_wq || !nhelpers || bytes < fbP->flush_mt_min) {
+		men_16z044_FlushRows(fbP, &r, r.y1, r.y2);
+	} else {
+		mode = MEN_16Z044_FLUSH_PARALLEL;
+		fbP->flush_rect   = r;
+		fbP->flush_lines  = lines;
+		fbP->flush_nbands = nbands;
+		atomic_set(&fbP->flush_next, 0);
+
+		self = raw_smp_processor_id();
+		for_each_online_cpu(cpu) {
+			if (i >= nhelpers)
+				break;
+			if (cpu == self)
+				continue;
+			queue_work_on(cpu, fbP->flush_wq, &fbP->flusher[i++].work);
+		}
+		men_16z044_FlushBands(fbP);
+		while (i--)
+			flush_work(&fbP->flusher[i].work);
+	}
+	wmb();
+	fbP->vt_valid |= BIT(fbP->vt_slot);
+
+	ns = ktime_to_ns(ktime_sub(ktime_get(), t0));
+	trace_fb16z044_flush(fbP->name, r.x1, r.y1, r.x2, r.y2, bytes,
+	                     mode == MEN_16Z044_FLUSH_PARALLEL, ns);
+
+	fbP->flush_count[mode]++;
+	fbP->flush_bytes[mode] += bytes;
+	fbP->flush_ns[mode]    += ns;
+	men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_WR, bytes);
+	men_16z044_StatOpNs(fbP, MEN_16Z044_OP_FLUSH, ns);
+pan:
+	/* FOFFS is latched at vblank, the new rows are written before.
+	 * Compared with the flush's own last value, not the register, so a
+	 * screen selected by SET_SCREEN stays until the own screen moves */
+	foffs = men_16z044_ScreenOffs(fbP);
+	if (foffs != fbP->pan_foffs && !fbP->anim_count &&
+	    !fbP->splash_handle) {
+		men_16z044_WriteFrameOffset(fbP, foffs);
+		fbP->pan_foffs = foffs;
+	}
+out:
+	mutex_unlock(&fbP->flush_mutex);
+}
+
+/**********************************************************************/
+/** delayed work that flushes the collected damage
+ *
+ * \param \IN    work   work_struct embedded in fbP->flush_work
+ */
+static void men_16z044_FlushWork(struct work_struct *work)
+{
+	struct MEN_16Z044_FB *fbP =
+		container_of(work, struct MEN_16Z044_FB, flush_work.work);
+
+	men_16z044_Flush(fbP);
+}
+
+/**********************************************************************/
+/** add a rect to the damaged area and schedule its flush
+ *
+ * \brief  May be called from atomic context (fbcon drawing).
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    x,y    upper left corner of the damaged rect
+ * \param \IN    w,h    size of the damaged rect
+ */
+static void men_16z044_Damage(struct MEN_16Z044_FB *fbP,
+                              u32 x, u32 y, u32 w, u32 h)
+{
+	struct MEN_16Z044_RECT *d = &fbP->damage;
+	unsigned long flags;
+	u32 x2, y2;
+
+	/* packed pixels are flushed in whole lines */
+	if (fbP->bits_per_pixel < 8) {
+		x = 0;
+		w = fbP->xres;
+	}
+	x2 = min_t(u32, x + w, fbP->xres);
+	y2 = min_t(u32, y + h, fbP->yres_virtual);
+
+	if (x >= x2 || y >= y2)
+		return;
+
+	men_16z044_Activity(fbP);
+	spin_lock_irqsave(&fbP->damage_lock, flags);
+	if (d->x1 >= d->x2 || d->y1 >= d->y2) {
+		d->x1 = x;
+		d->y1 = y;
+		d->x2 = x2;
+		d->y2 = y2;
+	} else {
+		d->x1 = min(d->x1, x);
+		d->y1 = min(d->y1, y);
+		d->x2 = max(d->x2, x2);
+		d->y2 = max(d->y2, y2);
+	}
+	spin_unlock_irqrestore(&fbP->damage_lock, flags);
+
+	schedule_delayed_work(&fbP->flush_work, MEN_16Z044_FLUSH_DELAY);
+}
+
+/**********************************************************************/
+/** damage the full lines touched by the byte range [start, end)
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    start  first byte offset in the shadow buffer
+ * \param \IN    end    byte offset after the range
+ */
+static void men_16z044_DamageBytes(struct MEN_16Z044_FB *fbP,
+                                   unsigned long start, unsigned long end)
+{
+	u32 y1 = start / fbP->line_length;
+	u32 y2 = DIV_ROUND_UP(end, fbP->line_length);
+
+	men_16z044_Damage(fbP, 0, y1, fbP->xres, y2 - y1);
+}
+
+/**********************************************************************/
+/** fb_pan_display, show the screen at var->yoffset of yres_virtual
+ *
+ * \brief  With coalesce fbcon scrolls by panning over the screens stacked
+ *         in the shadow. The offset is only recorded here, the flush
+ *         writes it to FOFFS after the damage, so any number of scrolls
+ *         within a frame end up as one pan plus the dirty lines. Without
+ *         coalescing yres_virtual is yres and only offset 0 is accepted.
+ *
+ * \param \IN    var    xoffset and yoffset to show
+ * \param \IN    info   fb_info of the display
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_pan_display(struct fb_var_screeninfo *var,
+                                  struct fb_info *info)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+
+	if (!fbP)
+		return -ENODEV;
+	if (var->xoffset || var->yoffset > fbP->yres_virtual - fbP->yres)
+		return -EINVAL;
+	if (!fbP->shadow || var->yoffset == READ_ONCE(fbP->pan_yoffset))
+		return 0;
+
+	men_16z044_Activity(fbP);
+	WRITE_ONCE(fbP->pan_yoffset, var->yoffset);
+	schedule_delayed_work(&fbP->flush_work, MEN_16Z044_FLUSH_DELAY);
+	return 0;
+}
+
+/**********************************************************************/
+/** fb_deferred_io callback, the mmap'ed shadow pages were written to
+ *
+ * \param \IN    info      fb_info of the display
+ * \param \IN    pagelist  list of the dirty pages
+ */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,19,0)
+static void men_16z044_DeferredIo(struct fb_info *info,
+                                  struct list_head *pagereflist)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	struct fb_deferred_io_pageref *pageref;
+	unsigned long start = ULONG_MAX, end = 0;
+
+	if (!fbP)
+		return;
+
+	list_for_each_entry(pageref, pagereflist, list) {
+		start = min(start, pageref->offset);
+		end   = max(end, pageref->offset + PAGE_SIZE);
+	}
+#else
+static void men_16z044_DeferredIo(struct fb_info *info,
+                                  struct list_head *pagelist)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	struct page *page;
+	unsigned long start = ULONG_MAX, end = 0;
+
+	if (!fbP)
+		return;
+
+	list_for_each_entry(page, pagelist, lru) {
+		start = min(start, page->index << PAGE_SHIFT);
+		end   = max(end, (page->index << PAGE_SHIFT) + PAGE_SIZE);
+	}
+#endif
+	if (start >= end)
+		return;
+
+	men_16z044_StatCall(fbP, MEN_16Z044_OP_DEFIO);
+	men_16z044_DamageBytes(fbP, start, min_t(unsigned long, end,
+	                                         fbP->shadow_size));
+	/* we already run delayed, no need to wait for flush_work */
+	men_16z044_Flush(fbP);
+}
+
+/*-----------------------------------------------------------------------+
+ |  refresh governor                                                     |
+ +-----------------------------------------------------------------------*/
+static const char *G_govNames[MEN_16Z044_GOV_NUM] = {
+	"fixed", "auto", "powersave"
+};
+
+/**********************************************************************/
+/** program a refresh rate chosen by the governor, count changes
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    rate   MEN_16Z044_REFRESH_60HZ or _75HZ
+ */
+static void men_16z044_GovSet(struct MEN_16Z044_FB *fbP, unsigned int rate)
+{
+	if (fbP->hw_rate == rate)
+		return;
+
+	men_16z044_SetRefreshRate(fbP, rate);
+	men_16z044_StatAdd(fbP, MEN_16Z044_ST_REFRESH_SW, 1);
+	DPRINTK("%s: governor %u Hz\n", fbP->name, rate);
+}
+
+/**********************************************************************/
+/** sample the upload rate and select the refresh rate
+ *
+ * \brief  With policy auto the SDRAM write rate is sampled every
+ *         MEN_16Z044_GOV_PERIOD_MS. At refresh_burst MB/s or more the
+ *         display drops to 60 Hz, which leaves the uploads the SDRAM
+ *         bandwidth of every fifth frame the scanout no longer fetches.
+ *         The wanted rate returns after refresh_idle ms below half of
+ *         refresh_burst. Needs the statistics, without them the upload
+ *         rate reads as 0.
+ *
+ * \param \IN    work   work_struct embedded in fbP->gov_work
+ */
+static void men_16z044_GovWork(struct work_struct *work)
+{
+	struct MEN_16Z044_FB *fbP =
+		container_of(work, struct MEN_16Z044_FB, gov_work.work);
+	ktime_t now = ktime_get();
+	u64 bytes = 0, delta;
+	s64 ms;
+	unsigned int mbs;
+	int cpu;
+
+	switch (fbP->refresh_policy) {
+	case MEN_16Z044_GOV_AUTO:
+		break;
+	case MEN_16Z044_GOV_POWERSAVE:
+		men_16z044_GovSet(fbP, MEN_16Z044_REFRESH_60HZ);
+		return;
+	default:
+		men_16z044_GovSet(fbP, fbP->refresh_rate);
+		return;
+	}
+
+	if (fbP->stats)
+		for_each_possible_cpu(cpu)
+			bytes += per_cpu_ptr(fbP->stats, cpu)->
+			         cnt[MEN_16Z044_ST_SDRAM_WR];
+	/* a debugfs reset clears the counters */
+	delta = bytes >= fbP->gov_bytes ? bytes - fbP->gov_bytes : bytes;
+	ms = max_t(s64, ktime_to_ms(ktime_sub(now, fbP->gov_stamp)), 1);
+	fbP->gov_bytes = bytes;
+	fbP->gov_stamp = now;
+	/* bytes/ms / 1000 is MB/s */
+	mbs = div64_u64(delta, ms * 1000);
+
+	if (mbs >= fbP->refresh_burst) {
+		fbP->gov_quiet = 0;
+		men_16z044_GovSet(fbP, MEN_16Z044_REFRESH_60HZ);
+	} else if (mbs < fbP->refresh_burst / 2) {
+		fbP->gov_quiet = min_t(s64, fbP->gov_quiet + ms, UINT_MAX);
+		if (fbP->gov_quiet >= fbP->refresh_idle)
+			men_16z044_GovSet(fbP, fbP->refresh_rate);
+	}
+
+	schedule_delayed_work(&fbP->gov_work,
+	                      msecs_to_jiffies(MEN_16Z044_GOV_PERIOD_MS));
+}
+
+/**********************************************************************/
+/** set the refresh rate wanted by the user
+ *
+ * \brief  Programmed at once with policy fixed, otherwise the governor
+ *         decides when the rate is used.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    rate   MEN_16Z044_REFRESH_60HZ or _75HZ
+ *
+ * \returns 0 if success / negative errorcode on error
+ */
+static int men_16z044_SetWantedRate(struct MEN_16Z044_FB *fbP,
+                                    unsigned int rate)
+{
+	if (rate != MEN_16Z044_REFRESH_60HZ && rate != MEN_16Z044_REFRESH_75HZ)
+		return -EINVAL;
+
+	fbP->refresh_rate = rate;
+	if (fbP->refresh_policy == MEN_16Z044_GOV_FIXED)
+		return men_16z044_SetRefreshRate(fbP, rate);
+
+	mod_delayed_work(system_wq, &fbP->gov_work, 0);
+	return 0;
+}
+
+/*-----------------------------------------------------------------------+
+ |  4bpp drawing into the shadow, two pixels per byte, left one in the   |
+ |  high nibble like the panel expects it                                |
+ +-----------------------------------------------------------------------*/
+static inline u8 *men_16z044_Pix4(struct MEN_16Z044_FB *fbP, u32 x, u32 y)
+{
+	return fbP->shadow + y * fbP->line_length + x / 2;
+}
+
+static inline u8 men_16z044_Get4(const u8 *p, u32 x)
+{
+	return (x & 1) ? *p & 0x0f : *p >> 4;
+}
+
+static inline void men_16z044_Put4(u8 *p, u32 x, u8 v)
+{
+	if (x & 1)
+		*p = (*p & 0xf0) | v;
+	else
+		*p = (*p & 0x0f) | (v << 4);
+}
+
+/* byte of two pixels for two bits of a glyph, 0xf where the bit is set */
+static const u8 G_nib2[4] = { 0x00, 0x0f, 0xf0, 0xff };
+
+/**********************************************************************/
+/** fill/xor a rect, whole bytes in the middle, nibbles at the edges
+ */
+static void men_16z044_Fill4(struct MEN_16Z044_FB *fbP,
+                             const struct fb_fillrect *rect)
+{
+	u8 c = rect->color & 0xf, cc = c * 0x11;
+	u32 x1 = rect->dx, x2 = rect->dx + rect->width, y, i;
+	u32 b1 = DIV_ROUND_UP(x1, 2), b2 = x2 / 2;  /* whole bytes [b1, b2) */
+	u8 *row, *p;
+
+	if (!rect->width)
+		return;
+
+	for (y = rect->dy; y < rect->dy + rect->height; y++) {
+		row = fbP->shadow + y * fbP->line_length;
+		if (x1 & 1)
+			men_16z044_Put4(row + x1 / 2, x1, rect->rop == ROP_XOR ?
+			                c ^ men_16z044_Get4(row + x1 / 2, x1) : c);
+		if (b2 > b1) {
+			if (rect->rop == ROP_XOR)
+				for (p = row + b1, i = b1; i < b2; i++)
+					*p++ ^= cc;
+			else
+				memset(row + b1, cc, b2 - b1);
+		}
+		if ((x2 & 1) && x2 - 1 >= x1 + (x1 & 1))
+			men_16z044_Put4(row + x2 / 2, x2 - 1, rect->rop == ROP_XOR ?
+			                c ^ men_16z044_Get4(row + x2 / 2, x2 - 1) : c);
+	}
+}
+
+/**********************************************************************/
+/** copy a rect, rows are moved as bytes when source and destination
+ *  have the same nibble alignment and are different rows
+ */
+static void men_16z044_Copy4(struct MEN_16Z044_FB *fbP,
+                             const struct fb_copyarea *area)
+{
+	/* copy backwards if the destination overlaps behind the source */
+	int back = area->dy > area->sy ||
+	           (area->dy == area->sy && area->dx > area->sx);
+	u32 w = area->width, i, j, x, y, sx, sy, n;
+	u8 *d, *s;
+
+	if (!w)
+		return;
+
+	for (j = 0; j < area->height; j++) {
+		y  = back ? area->dy + area->height - 1 - j : area->dy + j;
+		sy = back ? area->sy + area->height - 1 - j : area->sy + j;
+
+		if (!((area->dx ^ area->sx) & 1) && y != sy) {
+			x  = area->dx;
+			sx = area->sx;
+			d  = men_16z044_Pix4(fbP, x, y);
+			s  = men_16z044_Pix4(fbP, sx, sy);
+			i  = 0;
+			if (x & 1) {
+				men_16z044_Put4(d++, x, men_16z044_Get4(s++, sx));
+				i = 1;
+			}
+			n = (w - i) / 2;
+			memmove(d, s, n);
+			i += 2 * n;
+			if (i < w)
+				men_16z044_Put4(d + n, x + i,
+				                men_16z044_Get4(s + n, sx + i));
+			continue;
+		}
+
+		for (i = 0; i < w; i++) {
+			x  = back ? area->dx + w - 1 - i : area->dx + i;
+			sx = back ? area->sx + w - 1 - i : area->sx + i;
+			men_16z044_Put4(men_16z044_Pix4(fbP, x, y), x,
+			                men_16z044_Get4(men_16z044_Pix4(fbP, sx, sy),
+			                                sx));
+		}
+	}
+}
+
+/**********************************************************************/
+/** draw an image, glyphs at even x are expanded two pixels per table
+ *  lookup straight into whole bytes
+ */
+static void men_16z044_Blit4(struct MEN_16Z044_FB *fbP,
+                             const struct fb_image *image)
+{
+	u32 pitch = DIV_ROUND_UP(image->width, 8);
+	const u8 *src = (const u8 *)image->data, *g;
+	u8 fg = (image->fg_color & 0xf) * 0x11;
+	u8 bg = (image->bg_color & 0xf) * 0x11;
+	u32 i, j, x, y;
+	u8 m, v, *d;
+
+	if (image->depth == 1 && !(image->dx & 1)) {
+		for (j = 0; j < image->height; j++) {
+			g = src + j * pitch;
+			d = men_16z044_Pix4(fbP, image->dx, image->dy + j);
+			for (i = 0; i + 1 < image->width; i += 2) {
+				m = G_nib2[(g[i / 8] >> (6 - (i & 7))) & 3];
+				*d++ = (fg & m) | (bg & ~m);
+			}
+			if (i < image->width)
+				men_16z044_Put4(d, 0, (g[i / 8] & (0x80 >> (i & 7))) ?
+				                fg & 0xf : bg & 0xf);
+		}
+		return;
+	}
+
+	for (j = 0; j < image->height; j++) {
+		y = image->dy + j;
+		for (i = 0; i < image->width; i++) {
+			x = image->dx + i;
+			/* monochrome glyphs or one palette index per byte */
+			if (image->depth == 1)
+				v = (src[j * pitch + i / 8] & (0x80 >> (i & 7))) ?
+				    image->fg_color : image->bg_color;
+			else
+				v = src[j * image->width + i];
+			men_16z044_Put4(men_16z044_Pix4(fbP, x, y), x, v & 0xf);
+		}
+	}
+}
+
+/*-----------------------------------------------------------------------+
+ |  drawing operations, into the shadow buffer or directly into SDRAM    |
+ +-----------------------------------------------------------------------*/
+static void men_16z044_fillrect(struct fb_info *info,
+                                const struct fb_fillrect *rect)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	u32 bytes = men_16z044_Bytes(fbP, rect->width, rect->height);
+	ktime_t t0 = ktime_get();
+
+	trace_fb16z044_fillrect(fbP->name, rect->dx, rect->dy, rect->width,
+	                        rect->height, bytes);
+	if (fbP->bits_per_pixel == 4) {
+		men_16z044_Fill4(fbP, rect);
+		men_16z044_Damage(fbP, rect->dx, rect->dy, rect->width,
+		                  rect->height);
+	} else if (fbP->shadow) {
+		sys_fillrect(info, rect);
+		men_16z044_Damage(fbP, rect->dx, rect->dy, rect->width,
+		                  rect->height);
+	} else {
+		men_16z044_Activity(fbP);
+		if (rect->rop == ROP_COPY && fbP->bits_per_pixel == 16)
+			men_16z044_FillIo(fbP, rect);
+		else
+			cfb_fillrect(info, rect);
+		men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_WR, bytes);
+		if (rect->rop != ROP_COPY) {
+			men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_RD, bytes);
+			men_16z044_CaptureRect(fbP, MEN_16Z044_CAP_SDRAM_RD,
+			                       rect->dx, rect->dy, rect->width,
+			                       rect->height);
+		}
+		men_16z044_CaptureRect(fbP, MEN_16Z044_CAP_SDRAM_WR, rect->dx,
+		                       rect->dy, rect->width, rect->height);
+	}
+	men_16z044_StatOp(fbP, MEN_16Z044_OP_FILLRECT, t0);
+}
+
+static void men_16z044_copyarea(struct fb_info *info,
+                                const struct fb_copyarea *area)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	u32 bytes = men_16z044_Bytes(fbP, area->width, area->height);
+	ktime_t t0 = ktime_get();
+
+	trace_fb16z044_copyarea(fbP->name, area->dx, area->dy, area->width,
+	                        area->height, bytes);
+	if (fbP->bits_per_pixel == 4) {
+		men_16z044_Copy4(fbP, area);
+		men_16z044_Damage(fbP, area->dx, area->dy, area->width,
+		                  area->height);
+	} else if (fbP->shadow) {
+		sys_copyarea(info, area);
+		men_16z044_Damage(fbP, area->dx, area->dy, area->width,
+		                  area->height);
+	} else {
+		men_16z044_Activity(fbP);
+		/* the source is read back over PCI */
+		cfb_copyarea(info, area);
+		men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_WR, bytes);
+		men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_RD, bytes);
+		men_16z044_CaptureRect(fbP, MEN_16Z044_CAP_SDRAM_RD, area->sx,
+		                       area->sy, area->width, area->height);
+		men_16z044_CaptureRect(fbP, MEN_16Z044_CAP_SDRAM_WR, area->dx,
+		                       area->dy, area->width, area->height);
+	}
+	men_16z044_StatOp(fbP, MEN_16Z044_OP_COPYAREA, t0);
+}
+
+static void men_16z044_imageblit(struct fb_info *info,
+                                 const struct fb_image *image)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	u32 bytes = men_16z044_Bytes(fbP, image->width, image->height);
+	ktime_t t0 = ktime_get();
+
+	trace_fb16z044_imageblit(fbP->name, image->dx, image->dy, image->width,
+	                         image->height, bytes);
+	if (fbP->bits_per_pixel == 4) {
+		men_16z044_Blit4(fbP, image);
+		men_16z044_Damage(fbP, image->dx, image->dy, image->width,
+		                  image->height);
+	} else if (fbP->shadow) {
+		sys_imageblit(info, image);
+		men_16z044_Damage(fbP, image->dx, image->dy, image->width,
+		                  image->height);
+	} else {
+		men_16z044_Activity(fbP);
+		cfb_imageblit(info, image);
+		men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_WR, bytes);
+		men_16z044_CaptureRect(fbP, MEN_16Z044_CAP_SDRAM_WR, image->dx,
+		                       image->dy, image->width, image->height);
+	}
+	men_16z044_StatOp(fbP, MEN_16Z044_OP_IMAGEBLIT, t0);
+}
+
+static ssize_t men_16z044_sh_write(struct fb_info *info,
+                                   const char __user *buf,
+                                   size_t count, loff_t *ppos)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	loff_t start = *ppos;
+	ssize_t ret;
+
+	men_16z044_StatCall(fbP, MEN_16Z044_OP_WRITE);
+	ret = fb_sys_write(info, buf, count, ppos);
+	if (ret > 0)
+		men_16z044_DamageBytes(fbP, start, start + ret);
+
+	return ret;
+}
+
+/*-----------------------------------------------------------------------+
+ |  mode switching                                                       |
+ +-----------------------------------------------------------------------*/
+/**********************************************************************/
+/** find a resolution in G_resol
+ *
+ * \param \IN    xres, yres  visible size in pixels
+ *
+ * \returns index in G_resol or -1 if not supported
+ */
+static int men_16z044_FindRes(u32 xres, u32 yres)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(G_resol); i++)
+		if (G_resol[i].xres == xres && G_resol[i].yres == yres)
+			return i;
+	return -1;
+}
+
+/**********************************************************************/
+/** visible width and height of a mode as the client sees it, 90 and 270
+ *  degree rotation swap them
+ */
+static inline u32 men_16z044_RotX(unsigned int res, unsigned int rot)
+{
+	return rot & 1 ? G_resol[res].yres : G_resol[res].xres;
+}
+
+static inline u32 men_16z044_RotY(unsigned int res, unsigned int rot)
+{
+	return rot & 1 ? G_resol[res].xres : G_resol[res].yres;
+}
+
+/**********************************************************************/
+/** bytes of one screen in a mode at bpp bits per pixel
+ */
+static inline u32 men_16z044_ResBytes(unsigned int res, u32 bpp)
+{
+	return G_resol[res].xres * G_resol[res].yres * bpp / 8;
+}
+
+/**********************************************************************/
+/** screens of a mode that fit into SDRAM for coalescing, at least 1
+ */
+static u32 men_16z044_SdramScreens(struct MEN_16Z044_FB *fbP,
+                                   unsigned int res)
+{
+	u32 n = fbP->sdram_size /
+	        men_16z044_ResBytes(res, G_resol[res].bits_per_pixel);
+
+	return clamp_t(u32, n, 1, max(fbP->coalesce, 1u));
+}
+
+/**********************************************************************/
+/** screens fbcon may pan over in a mode, yres_virtual = n * yres
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    res    index in G_resol
+ * \param \IN    bpp    bits per pixel of the fb device
+ * \param \IN    rot    FB_ROTATE_* of the mode
+ *
+ * \returns 1 without coalescing, else what fits SDRAM and shadow
+ */
+static u32 men_16z044_PanScreens(struct MEN_16Z044_FB *fbP,
+                                 unsigned int res, u32 bpp, unsigned int rot)
+{
+	if (!fbP->coalesce || !fbP->shadow || rot)
+		return 1;
+	return clamp_t(u32, fbP->shadow_size / men_16z044_ResBytes(res, bpp),
+	               1, men_16z044_SdramScreens(fbP, res));
+}
+
+/**********************************************************************/
+/** color fields of a mode, see men_16z044_InitVarFb()
+ *
+ * \param \IN    var    mode whose bits_per_pixel is set
+ */
+static void men_16z044_VarColors(struct fb_var_screeninfo *var)
+{
+	var->grayscale = 0;    /* != 0 Graylevels instead of colors */
+	memset(&var->red, 0, sizeof(var->red));
+	memset(&var->green, 0, sizeof(var->green));
+	memset(&var->blue, 0, sizeof(var->blue));
+	memset(&var->transp, 0, sizeof(var->transp));
+	switch (var->bits_per_pixel) {
+	case 4: /* palette index, shown as gray level */
+		var->grayscale    = 1;
+		var->red.length   = 4;
+		break;
+	case 8: /* palette index, expanded to RGB565 at flush */
+		var->red.length   = 8;
+		break;
+	case 32:/* XRGB8888, converted to RGB565 at flush */
+		var->red.offset   = 16;
+		var->red.length   = 8;
+		var->green.offset = 8;
+		var->green.length = 8;
+		var->blue.length  = 8;
+		return;
+	case 15:/* 32k */
+	case 16:
+		var->red.offset   = 11;
+		var->red.length   = 5;
+		var->green.offset = 5;
+		var->green.length = 6;
+		var->blue.offset  = 0;
+		var->blue.length  = 5;
+		return;
+	default:/* not supported (yet) */
+		printk(KERN_ERR "no support for %dbpp\n", var->bits_per_pixel);
+		/* fbP->disp.dispsw = &fbcon_dummy;   /\* ??? *\/ */
+		return;
+	}
+	var->green = var->red;
+	var->blue  = var->red;
+}
+
+/**********************************************************************/
+/** fb_check_var, accept the modes of G_resol
+ *
+ * \brief  Modes other than the current one need modeswitch=1, the
+ *         resolution of most FPGA variants is fixed. The 256x64 panel
+ *         mode is never switched to or from. With the shadow 8bpp
+ *         pseudocolour or 32bpp XRGB8888 may be chosen instead of RGB565
+ *         if the shadow is large enough. With rotation the geometry is
+ *         the rotated one. The virtual height is the visible one, with
+ *         coalesce it is the screens fbcon pans over, see
+ *         men_16z044_PanScreens().
+ *
+ * \param \IN    var    wanted mode, adjusted to what is supported
+ * \param \IN    info   fb_info of the display
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_check_var(struct fb_var_screeninfo *var,
+                                struct fb_info *info)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	int res;
+	u32 bpp;
+
+	if (!fbP)
+		return -ENODEV;
+
+	/* portrait rotation swaps the client geometry */
+	if (fbP->rotate_req & 1)
+		res = men_16z044_FindRes(var->yres, var->xres);
+	else
+		res = men_16z044_FindRes(var->xres, var->yres);
+	if (res < 0 || (res != fbP->res &&
+	                 (!fbP->modeswitch || res >= MEN_16Z044_RES_HW_NUM ||
+	                  fbP->res >= MEN_16Z044_RES_HW_NUM)))
+		return -EINVAL;
+
+	/* client formats converted by the shadow flush, not rotated */
+	bpp = G_resol[res].bits_per_pixel;
+	if ((var->bits_per_pixel == 8 || var->bits_per_pixel == 32) &&
+	    fbP->shadow && res < MEN_16Z044_RES_HW_NUM && !fbP->rotate_req)
+		bpp = var->bits_per_pixel;
+
+	if (men_16z044_ResBytes(res, G_resol[res].bits_per_pixel) >
+	    fbP->sdram_size ||
+	    (fbP->shadow && men_16z044_ResBytes(res, bpp) > fbP->shadow_size))
+		return -ENOMEM;
+
+	var->bits_per_pixel = bpp;
+	var->xres_virtual   = var->xres;
+	var->yres_virtual   = var->yres *
+		men_16z044_PanScreens(fbP, res, bpp, fbP->rotate_req);
+	var->xoffset        = 0;
+	var->yoffset        = 0;
+	var->nonstd         = 0;
+	men_16z044_VarColors(var);
+	return 0;
+}
+
+/**********************************************************************/
+/** program a resolution and rebuild everything depending on it
+ *
+ * \brief  Pending damage is dropped and the new screen is cleared. The
+ *         shadow is allocated for the largest mode with modeswitch=1, so
+ *         existing mmaps stay valid.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    res    index in G_resol
+ * \param \IN    bpp    bits per pixel of the fb device
+ */
+static void men_16z044_SetMode(struct MEN_16Z044_FB *fbP, unsigned int res,
+                               u32 bpp)
+{
+	struct fb_info *info = &fbP->info;
+	unsigned long flags;
+
+	/* splash and animation frames have the old geometry */
+	men_16z044_SplashHide(fbP);
+	men_16z044_AnimStop(fbP);
+
+	/* no flush may run with the old geometry */
+	if (fbP->shadow)
+		cancel_delayed_work_sync(&fbP->flush_work);
+	mutex_lock(&fbP->flush_mutex);
+
+	men_16z044_ModifyCtrl(fbP, MEN_16Z044_DISP_CTRL, MEN_16Z044_RES_MASK,
+	                      res | Z044_DISP_CTRL_CHANGE);
+	men_16z044_WriteFrameOffset(fbP, 0);
+
+	spin_lock_irqsave(&fbP->damage_lock, flags);
+	fbP->res             = res;
+	fbP->rotate          = fbP->rotate_req;
+	fbP->bits_per_pixel  = bpp;
+	fbP->bytes_per_pixel = fbP->bits_per_pixel >> 3;
+	fbP->xres            = men_16z044_RotX(res, fbP->rotate);
+	fbP->yres            = men_16z044_RotY(res, fbP->rotate);
+	fbP->yres_virtual    = fbP->yres *
+		men_16z044_PanScreens(fbP, res, bpp, fbP->rotate);
+	fbP->line_length     = fbP->xres * fbP->bits_per_pixel / 8;
+	fbP->hw_line_length  = men_16z044_HwBytes(fbP, G_resol[res].xres, 1);
+	fbP->damage.x2       = fbP->damage.y2 = 0;
+	fbP->pan_yoffset     = fbP->flush_offs = 0;
+	fbP->pan_foffs       = 0;
+	fbP->vt_slot         = 0;
+	fbP->vt_valid        = 0;
+	spin_unlock_irqrestore(&fbP->damage_lock, flags);
+
+	fbP->fix.line_length  = info->fix.line_length = fbP->line_length;
+	fbP->fix.visual       = info->fix.visual =
+		bpp <= 8 ? FB_VISUAL_PSEUDOCOLOR : FB_VISUAL_TRUECOLOR;
+	fbP->var              = info->var;
+
+	if (fbP->shadow)
+		memset(fbP->shadow, 0, fbP->shadow_size);
+	else
+		MEN_16Z044_FILL(fbP->sdram_virt, 0, men_16z044_HwFrame(fbP));
+	mutex_unlock(&fbP->flush_mutex);
+
+	if (fbP->shadow)
+		men_16z044_Damage(fbP, 0, 0, fbP->xres, fbP->yres_virtual);
+
+	printk(KERN_INFO "%s: resolution %d x %d, %dbpp, rotate %u\n",
+	       fbP->name, fbP->xres, fbP->yres, fbP->bits_per_pixel,
+	       fbP->rotate);
+}
+
+/**********************************************************************/
+/** fb_set_par, switch to the mode in info->var
+ *
+ * \param \IN    info   fb_info of the display
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_set_par(struct fb_info *info)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	int res;
+
+	if (!fbP)
+		return -ENODEV;
+
+	if (fbP->rotate_req & 1)
+		res = men_16z044_FindRes(info->var.yres, info->var.xres);
+	else
+		res = men_16z044_FindRes(info->var.xres, info->var.yres);
+	if (res < 0)
+		return -EINVAL;
+	if (res != fbP->res || info->var.bits_per_pixel != fbP->bits_per_pixel ||
+	    fbP->rotate_req != fbP->rotate)
+		men_16z044_SetMode(fbP, res, info->var.bits_per_pixel);
+	return 0;
+}
+
+/**********************************************************************/
+/** set a mode and resize fbcon to it
+ *
+ * \brief  Called with the console lock and the fb_info lock held.
+ *
+ * \param \IN    info   fb_info of the display
+ * \param \IN    var    mode to set
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_SetVar(struct fb_info *info,
+                             struct fb_var_screeninfo *var)
+{
+	int ret;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5,6,0)
+	ret = fb_set_var(info, var);
+	if (!ret)
+		fbcon_update_vcs(info, var->activate & FB_ACTIVATE_ALL);
+#else
+	info->flags |= FBINFO_MISC_USEREVENT;
+	ret = fb_set_var(info, var);
+	info->flags &= ~FBINFO_MISC_USEREVENT;
+#endif
+	return ret;
+}
+
+/**********************************************************************/
+/** switch the resolution for the FBIO_MEN_16Z044_RES_* ioctls
+ *
+ * \brief  Same as FBIOPUT_VSCREENINFO, fbcon is resized too. The fb core
+ *         calls fb_ioctl with the fb_info lock held, it is dropped here
+ *         because the console lock has to be taken first.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    res    index in G_resol
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_SwitchRes(struct MEN_16Z044_FB *fbP, unsigned int res)
+{
+	struct fb_info *info = &fbP->info;
+	struct fb_var_screeninfo var = info->var;
+	int ret;
+
+	var.xres     = var.xres_virtual = men_16z044_RotX(res, fbP->rotate_req);
+	var.yres     = var.yres_virtual = men_16z044_RotY(res, fbP->rotate_req);
+	var.activate = FB_ACTIVATE_NOW;
+
+	unlock_fb_info(info);
+	console_lock();
+	lock_fb_info(info);
+	ret = men_16z044_SetVar(info, &var);
+	console_unlock();
+
+	return ret;
+}
+
+/**********************************************************************/
+/** change the rotation, for the sysfs file rotate
+ *
+ * \brief  Like a mode switch: the screen is cleared and fbcon is resized
+ *         to the rotated geometry. Only RGB565 through the shadow can be
+ *         rotated.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    rot    FB_ROTATE_*
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_SetRotate(struct MEN_16Z044_FB *fbP, unsigned int rot)
+{
+	struct fb_info *info = &fbP->info;
+	struct fb_var_screeninfo var;
+	unsigned int old;
+	int ret;
+
+	console_lock();
+	lock_fb_info(info);
+	if (fbP->res >= MEN_16Z044_RES_HW_NUM ||
+	    fbP->bits_per_pixel != G_resol[fbP->res].bits_per_pixel) {
+		ret = -EINVAL;
+		goto out;
+	}
+
+	old = fbP->rotate_req;
+	fbP->rotate_req = rot;
+	var = info->var;
+	var.xres     = var.xres_virtual = men_16z044_RotX(fbP->res, rot);
+	var.yres     = var.yres_virtual = men_16z044_RotY(fbP->res, rot);
+	var.activate = FB_ACTIVATE_NOW | FB_ACTIVATE_FORCE;
+	ret = men_16z044_SetVar(info, &var);
+	if (ret)
+		fbP->rotate_req = old;
+out:
+	unlock_fb_info(info);
+	console_unlock();
+	return ret;
+}
+
+/*-----------------------------------------------------------------------+
+ |  off-screen SDRAM surfaces                                             |
+ +-----------------------------------------------------------------------*/
+/**********************************************************************/
+/** SDRAM bytes of the screens of a mode
+ *
+ * \brief  SdramScreens() bounds what PanScreens() gives the mode in
+ *         SetMode(), smaller modes may pan over more screens.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    res    index in G_resol
+ *
+ * \returns bytes of the visible, the coalesce and the VT screens
+ */
+static u64 men_16z044_VramScreens(struct MEN_16Z044_FB *fbP,
+                                  unsigned int res)
+{
+	u32 screens = max(men_16z044_SdramScreens(fbP, res),
+	                  max(fbP->vt_screens, 1U));
+
+	return (u64)men_16z044_ResBytes(res, G_resol[res].bits_per_pixel) *
+	       screens;
+}
+
+/**********************************************************************/
+/** set up the surface memory behind the screens
+ *
+ * \brief  The screens are the visible one, the coalesce and the VT
+ *         screens, of the mode needing the most of them among those
+ *         that may be switched to. Surfaces are allocated first fit in
+ *         the gaps of fbP->surfs.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void men_16z044_VramInit(struct MEN_16Z044_FB *fbP)
+{
+	u64 base = men_16z044_VramScreens(fbP, fbP->res);
+	int i;
+
+	if (fbP->modeswitch)
+		for (i = 0; i < MEN_16Z044_RES_HW_NUM; i++)
+			if (men_16z044_ResBytes(i, G_resol[i].bits_per_pixel) <=
+			    fbP->sdram_size)
+				base = max(base,
+				           men_16z044_VramScreens(fbP, i));
+
+	base = ALIGN(base, MEN_16Z044_VRAM_ALIGN);
+	fbP->vram_base = min_t(u64, base, fbP->sdram_size);
+	DPRINTK("%s: surfaces 0x%x..0x%x\n", fbP->name, fbP->vram_base,
+	        fbP->sdram_size);
+}
+
+/**********************************************************************/
+/** release all surfaces
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void __maybe_unused men_16z044_VramExit(struct MEN_16Z044_FB *fbP)
+{
+	struct MEN_16Z044_SURF *surf;
+
+	while (!list_empty(&fbP->surfs)) {
+		surf = list_first_entry(&fbP->surfs, struct MEN_16Z044_SURF,
+		                        list);
+		list_del(&surf->list);
+		put_pid(surf->owner);
+		kfree(surf);
+	}
+}
+
+/**********************************************************************/
+/** look up a surface of an owner, called with vram_lock held
+ *
+ * \param \IN    fbP     pointer to struct of 16z044 data
+ * \param \IN    handle  of SURF_ALLOC
+ * \param \IN    owner   process of the caller, NULL: the driver
+ *
+ * \returns the surface or NULL, also if another owner has it
+ */
+static struct MEN_16Z044_SURF *men_16z044_SurfFind(struct MEN_16Z044_FB *fbP,
+                                                   u32 handle,
+                                                   struct pid *owner)
+{
+	struct MEN_16Z044_SURF *surf;
+
+	list_for_each_entry(surf, &fbP->surfs, list)
+		if (surf->handle == handle)
+			return surf->owner == owner ? surf : NULL;
+	return NULL;
+}
+
+/**********************************************************************/
+/** check that a rect lies within w x h and starts and ends on bytes
+ *
+ * \returns 0 or -EINVAL
+ */
+static int men_16z044_SurfRect(u32 x, u32 y, u32 width, u32 height,
+                               u32 w, u32 h, u32 bpp)
+{
+	if (!width || !height || x > w || width > w - x ||
+	    y > h || height > h - y ||
+	    (x * bpp) % 8 || (width * bpp) % 8)
+		return -EINVAL;
+	return 0;
+}
+
+/**********************************************************************/
+/** allocate an off-screen surface
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \INOUT s      width and height in, handle, offset and pitch out
+ * \param \IN    owner  process of the caller, NULL: the driver
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_SurfAlloc(struct MEN_16Z044_FB *fbP,
+                                struct men_16z044_surface *s,
+                                struct pid *owner)
+{
+	struct MEN_16Z044_SURF *surf, *pos;
+	u32 bpp = G_resol[fbP->res].bits_per_pixel;
+	u64 offs, size;
+
+	if (!s->width || !s->height || s->width > MEN_16Z044_SURF_MAX ||
+	    s->height > MEN_16Z044_SURF_MAX || (s->width * bpp) % 8)
+		return -EINVAL;
+
+	surf = kzalloc(sizeof(*surf), GFP_KERNEL);
+	if (!surf)
+		return -ENOMEM;
+	surf->width  = s->width;
+	surf->height = s->height;
+	surf->pitch  = ALIGN(s->width * bpp / 8, 8);
+	size = ALIGN((u64)surf->pitch * s->height, MEN_16Z044_VRAM_ALIGN);
+
+	mutex_lock(&fbP->vram_lock);
+	/* first gap that is large enough, pos is the surface behind it */
+	offs = fbP->vram_base;
+	list_for_each_entry(pos, &fbP->surfs, list) {
+		if (pos->offs - offs >= size)
+			break;
+		offs = pos->offs + pos->size;
+	}
+	if (offs + size > fbP->sdram_size) {
+		mutex_unlock(&fbP->vram_lock);
+		kfree(surf);
+		return -ENOMEM;
+	}
+
+	surf->offs  = offs;
+	surf->size  = size;
+	surf->owner = get_pid(owner);
+	if (!++fbP->vram_handle)
+		fbP->vram_handle++;
+	surf->handle = fbP->vram_handle;
+	list_add_tail(&surf->list, &pos->list);
+	mutex_unlock(&fbP->vram_lock);
+
+	s->handle = surf->handle;
+	s->offset = surf->offs;
+	s->pitch  = surf->pitch;
+	DPRINTK("%s: surface %u %ux%u at 0x%x\n", fbP->name, surf->handle,
+	        surf->width, surf->height, surf->offs);
+	return 0;
+}
+
+/**********************************************************************/
+/** free an off-screen surface
+ *
+ * \param \IN    fbP     pointer to struct of 16z044 data
+ * \param \IN    handle  of SURF_ALLOC
+ * \param \IN    owner   process of the caller, NULL: the driver
+ *
+ * \returns 0 on success, -EBUSY while it is animated or errorcode
+ */
+static int men_16z044_SurfFree(struct MEN_16Z044_FB *fbP, u32 handle,
+                               struct pid *owner)
+{
+	struct MEN_16Z044_SURF *surf;
+	u32 i;
+
+	mutex_lock(&fbP->vram_lock);
+	surf = men_16z044_SurfFind(fbP, handle, owner);
+	/* not while it is a frame of the animation */
+	for (i = 0; surf && i < fbP->anim_count; i++) {
+		if (fbP->anim_handle[i] == handle) {
+			mutex_unlock(&fbP->vram_lock);
+			return -EBUSY;
+		}
+	}
+	if (surf)
+		list_del(&surf->list);
+	mutex_unlock(&fbP->vram_lock);
+
+	if (!surf)
+		return -EINVAL;
+	put_pid(surf->owner);
+	kfree(surf);
+	return 0;
+}
+
+/**********************************************************************/
+/** check if a surface is left over by a client
+ *
+ * \param \IN    surf   surface, vram_lock held
+ * \param \IN    all    every client closed the device
+ *
+ * \returns 1 if it is to be freed
+ */
+static int men_16z044_SurfOrphan(struct MEN_16Z044_SURF *surf, int all)
+{
+	int alive;
+
+	if (!surf->owner)
+		return 0;
+	if (all)
+		return 1;
+	rcu_read_lock();
+	alive = pid_task(surf->owner, PIDTYPE_PID) != NULL;
+	rcu_read_unlock();
+	return !alive;
+}
+
+/**********************************************************************/
+/** free the surfaces of clients that are gone
+ *
+ * \brief  Called on open and release of the device file: surfaces of
+ *         processes that exited are freed, those of all clients when the
+ *         last one closes the device. An animation of such surfaces is
+ *         stopped before. The splash belongs to the driver and stays.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    all    every client closed the device
+ */
+static void men_16z044_SurfReap(struct MEN_16Z044_FB *fbP, int all)
+{
+	struct MEN_16Z044_SURF *surf, *n;
+	LIST_HEAD(dead);
+	int anim = 0;
+	u32 i;
+
+	mutex_lock(&fbP->vram_lock);
+	for (i = 0; i < fbP->anim_count && !anim; i++) {
+		list_for_each_entry(surf, &fbP->surfs, list)
+			if (surf->handle == fbP->anim_handle[i] &&
+			    men_16z044_SurfOrphan(surf, all))
+				anim = 1;
+	}
+	mutex_unlock(&fbP->vram_lock);
+	if (anim)
+		men_16z044_AnimStop(fbP);
+
+	mutex_lock(&fbP->vram_lock);
+	list_for_each_entry_safe(surf, n, &fbP->surfs, list)
+		if (men_16z044_SurfOrphan(surf, all))
+			list_move(&surf->list, &dead);
+	mutex_unlock(&fbP->vram_lock);
+
+	list_for_each_entry_safe(surf, n, &dead, list) {
+		DPRINTK("%s: surface %u of a closed client freed\n",
+		        fbP->name, surf->handle);
+		put_pid(surf->owner);
+		kfree(surf);
+	}
+}
+
+/**********************************************************************/
+/** write pixels from user memory into a rect of a surface
+ *
+ * \brief  The pixels are in the SDRAM format and are copied unchanged,
+ *         one line at a time through a bounce buffer.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    u      surface, rect and user data
+ * \param \IN    owner  process of the caller
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_SurfUpload(struct MEN_16Z044_FB *fbP,
+                                 const struct men_16z044_surf_upload *u,
+                                 struct pid *owner)
+{
+	const u8 __user *data = (const u8 __user *)(uintptr_t)u->data;
+	u32 bpp = G_resol[fbP->res].bits_per_pixel;
+	struct MEN_16Z044_SURF *surf;
+	u32 len, offs, i;
+	int ret = 0;
+	u8 *buf = NULL;
+
+	/* the rect is checked before its width sizes anything */
+	mutex_lock(&fbP->vram_lock);
+	surf = men_16z044_SurfFind(fbP, u->handle, owner);
+	if (!surf || men_16z044_SurfRect(u->x, u->y, u->width, u->height,
+	                                 surf->width, surf->height, bpp)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	len = u->width * bpp / 8;
+	if (u->pitch < len) {
+		ret = -EINVAL;
+		goto out;
+	}
+	buf = kmalloc(surf->pitch, GFP_KERNEL);
+	if (!buf) {
+		ret = -ENOMEM;
+		goto out;
+	}
+
+	offs = surf->offs + u->y * surf->pitch + u->x * bpp / 8;
+	for (i = 0; i < u->height; i++, offs += surf->pitch) {
+		if (copy_from_user(buf, data + (size_t)i * u->pitch, len)) {
+			ret = -EFAULT;
+			break;
+		}
+		MEN_16Z044_COPY(fbP->sdram_virt + offs, buf, len);
+		men_16z044_Capture(fbP, MEN_16Z044_CAP_SDRAM_WR, offs, len, 1);
+	}
+	men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_WR, (u64)i * len);
+out:
+	mutex_unlock(&fbP->vram_lock);
+	kfree(buf);
+	return ret;
+}
+
+/**********************************************************************/
+/** copy a rect of a surface to the screen
+ *
+ * \brief  The 16Z044 has no blitter, the CPU reads the surface back over
+ *         PCI like cfb_copyarea does. With the shadow the rect is read
+ *         into it and flushed as damage, else it is written to the screen
+ *         directly. Needs a fb device in the SDRAM format, not rotated.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    b      surface, rect and screen position
+ * \param \IN    owner  process of the caller
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_SurfBlit(struct MEN_16Z044_FB *fbP,
+                               const struct men_16z044_surf_blit *b,
+                               struct pid *owner)
+{
+	u32 bpp = fbP->bits_per_pixel;
+	struct MEN_16Z044_SURF *surf;
+	u32 len, src, dst, i;
+	int ret = 0;
+	u8 *buf = NULL;
+
+	if (bpp != G_resol[fbP->res].bits_per_pixel || bpp < 8 || fbP->rotate)
+		return -EINVAL;
+	if (men_16z044_SurfRect(b->dx, b->dy, b->width, b->height,
+	                        fbP->xres, fbP->yres_virtual, bpp))
+		return -EINVAL;
+
+	mutex_lock(&fbP->vram_lock);
+	surf = men_16z044_SurfFind(fbP, b->handle, owner);
+	if (!surf || men_16z044_SurfRect(b->sx, b->sy, b->width, b->height,
+	                                 surf->width, surf->height, bpp)) {
+		ret = -EINVAL;
+		goto out;
+	}
+	len = b->width * bpp / 8;
+	if (!fbP->shadow) {
+		buf = kmalloc(surf->pitch, GFP_KERNEL);
+		if (!buf) {
+			ret = -ENOMEM;
+			goto out;
+		}
+	}
+
+	men_16z044_Activity(fbP);
+	src = surf->offs + b->sy * surf->pitch + b->sx * bpp / 8;
+	dst = b->dy * fbP->line_length + b->dx * bpp / 8;
+	for (i = 0; i < b->height; i++, src += surf->pitch,
+	     dst += fbP->line_length) {
+		men_16z044_Capture(fbP, MEN_16Z044_CAP_SDRAM_RD, src, len, 1);
+		if (fbP->shadow) {
+			memcpy_fromio(fbP->shadow + dst, fbP->sdram_virt + src,
+			              len);
+		} else {
+			memcpy_fromio(buf, fbP->sdram_virt + src, len);
+			MEN_16Z044_COPY(fbP->sdram_virt + dst, buf, len);
+			men_16z044_Capture(fbP, MEN_16Z044_CAP_SDRAM_WR, dst,
+			                   len, 1);
+		}
+	}
+	men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_RD, (u64)len * b->height);
+	if (fbP->shadow)
+		men_16z044_Damage(fbP, b->dx, b->dy, b->width, b->height);
+	else
+		men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_WR,
+		                   (u64)len * b->height);
+out:
+	mutex_unlock(&fbP->vram_lock);
+	kfree(buf);
+	return ret;
+}
+
+/**********************************************************************/
+/** delayed work, shows the next frame of the animation
+ *
+ * \brief  FOFFS is latched at vblank, so the frames change without
+ *         tearing. No pixel is moved, a frame costs one register write.
+ *
+ * \param \IN    work   work_struct embedded in fbP->anim_work
+ */
+static void men_16z044_AnimWork(struct work_struct *work)
+{
+	struct MEN_16Z044_FB *fbP =
+		container_of(work, struct MEN_16Z044_FB, anim_work.work);
+
+	mutex_lock(&fbP->flush_mutex);
+	if (fbP->anim_count) {
+		/* a playing animation is no idle display */
+		men_16z044_Activity(fbP);
+		men_16z044_WriteFrameOffset(fbP, fbP->anim_offs[fbP->anim_next]);
+		fbP->anim_next = (fbP->anim_next + 1) % fbP->anim_count;
+		schedule_delayed_work(&fbP->anim_work, fbP->anim_interval);
+	}
+	mutex_unlock(&fbP->flush_mutex);
+}
+
+/**********************************************************************/
+/** stop the animation and show the screen of the fb device again
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ *
+ * \returns 0
+ */
+static int men_16z044_AnimStop(struct MEN_16Z044_FB *fbP)
+{
+	u32 *handle, *offs;
+
+	mutex_lock(&fbP->vram_lock);
+	mutex_lock(&fbP->flush_mutex);
+	handle = fbP->anim_handle;
+	offs   = fbP->anim_offs;
+	fbP->anim_handle = fbP->anim_offs = NULL;
+	if (fbP->anim_count) {
+		fbP->anim_count = 0;
+		fbP->pan_foffs  = men_16z044_ScreenOffs(fbP);
+		men_16z044_WriteFrameOffset(fbP, fbP->pan_foffs);
+	}
+	mutex_unlock(&fbP->flush_mutex);
+	mutex_unlock(&fbP->vram_lock);
+
+	cancel_delayed_work_sync(&fbP->anim_work);
+	kfree(handle);
+	kfree(offs);
+	return 0;
+}
+
+/**********************************************************************/
+/** show screen sized surfaces in turn by frame offset
+ *
+ * \brief  The frames are uploaded once with SURF_UPLOAD, afterwards the
+ *         animation runs from a delayed work without userspace and
+ *         without SDRAM writes until FBIO_MEN_16Z044_ANIM_STOP, a mode
+ *         switch or the removal of the device. The fb device is not shown
+ *         meanwhile, its drawing is flushed as usual.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    a      interval, count and user address of the handles
+ * \param \IN    owner  process of the caller
+ *
+ * \returns 0 on success or errorcode
+ */
+static int men_16z044_AnimStart(struct MEN_16Z044_FB *fbP,
+                                const struct men_16z044_anim *a,
+                                struct pid *owner)
+{
+	const void __user *uh = (const void __user *)(uintptr_t)a->handles;
+	u32 xres = G_resol[fbP->res].xres, yres = G_resol[fbP->res].yres;
+	struct MEN_16Z044_SURF *surf;
+	u32 *handle, *offs, i;
+
+	if (!a->count || a->count > MEN_16Z044_ANIM_MAX || !a->interval_ms)
+		return -EINVAL;
+
+	men_16z044_SplashHide(fbP);
+	men_16z044_AnimStop(fbP);
+
+	handle = kcalloc(a->count, sizeof(u32), GFP_KERNEL);
+	offs   = kcalloc(a->count, sizeof(u32), GFP_KERNEL);
+	if (!handle || !offs) {
+		kfree(handle);
+		kfree(offs);
+		return -ENOMEM;
+	}
+	if (copy_from_user(handle, uh, a->count * sizeof(u32))) {
+		kfree(handle);
+		kfree(offs);
+		return -EFAULT;
+	}
+
+	mutex_lock(&fbP->vram_lock);
+	/* every frame must be scanned out like a screen of the mode */
+	for (i = 0; i < a->count; i++) {
+		surf = men_16z044_SurfFind(fbP, handle[i], owner);
+		if (!surf || surf->width != xres || surf->height < yres ||
+		    surf->pitch != fbP->hw_line_length) {
+			mutex_unlock(&fbP->vram_lock);
+			kfree(handle);
+			kfree(offs);
+			return -EINVAL;
+		}
+		offs[i] = surf->offs;
+	}
+
+	mutex_lock(&fbP->flush_mutex);
+	fbP->anim_handle   = handle;
+	fbP->anim_offs     = offs;
+	fbP->anim_next     = 0;
+	fbP->anim_interval = max(msecs_to_jiffies(a->interval_ms), 1UL);
+	fbP->anim_count    = a->count;
+	mutex_unlock(&fbP->flush_mutex);
+	mutex_unlock(&fbP->vram_lock);
+
+	schedule_delayed_work(&fbP->anim_work, 0);
+	DPRINTK("%s: animation of %u frames, %u ms\n", fbP->name, a->count,
+	        a->interval_ms);
+	return 0;
+}
+
+/**********************************************************************/
+/** load the boot splash into a surface and show it
+ *
+ * \brief  The firmware file holds one screen of the current mode in the
+ *         SDRAM format, it is written once. fbcon and the flush draw into
+ *         the screen behind it until men_16z044_SplashHide() shows that.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void __maybe_unused men_16z044_SplashInit(struct MEN_16Z044_FB *fbP)
+{
+	struct men_16z044_surface s;
+	const struct firmware *fw;
+	u32 frame = men_16z044_HwFrame(fbP);
+
+	if (!splash || !*splash)
+		return;
+	if (request_firmware(&fw, splash, &fbP->pdev->dev)) {
+		printk(KERN_WARNING "%s: splash %s not found\n", fbP->name,
+		       splash);
+		return;
+	}
+
+	memset(&s, 0, sizeof(s));
+	s.width  = G_resol[fbP->res].xres;
+	s.height = G_resol[fbP->res].yres;
+	if (fw->size != frame) {
+		printk(KERN_WARNING "%s: splash %s has %zu bytes, not %u\n",
+		       fbP->name, splash, fw->size, frame);
+	} else if (men_16z044_SurfAlloc(fbP, &s, NULL)) {
+		printk(KERN_WARNING "%s: no off-screen memory for the splash\n",
+		       fbP->name);
+	} else {
+		MEN_16Z044_COPY(fbP->sdram_virt + s.offset, fw->data, frame);
+		men_16z044_StatAdd(fbP, MEN_16Z044_ST_SDRAM_WR, frame);
+
+		mutex_lock(&fbP->flush_mutex);
+		fbP->splash_handle = s.handle;
+		men_16z044_WriteFrameOffset(fbP, s.offset);
+		mutex_unlock(&fbP->flush_mutex);
+
+		if (splash_ms)
+			schedule_delayed_work(&fbP->splash_work,
+			                      msecs_to_jiffies(splash_ms));
+		printk(KERN_INFO "%s: splash %s\n", fbP->name, splash);
+	}
+	release_firmware(fw);
+}
+
+/**********************************************************************/
+/** hide the boot splash, the screen of the fb device is shown instead
+ *
+ * \brief  Called when the first client opens the device, on a write of
+ *         0 to the sysfs file splash, after splash_ms and before mode
+ *         switches and animations. The console was drawn all along, no
+ *         redraw is needed.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void men_16z044_SplashHide(struct MEN_16Z044_FB *fbP)
+{
+	u32 handle;
+
+	mutex_lock(&fbP->flush_mutex);
+	handle = fbP->splash_handle;
+	fbP->splash_handle = 0;
+	if (handle && !fbP->anim_count) {
+		fbP->pan_foffs = men_16z044_ScreenOffs(fbP);
+		men_16z044_WriteFrameOffset(fbP, fbP->pan_foffs);
+	}
+	mutex_unlock(&fbP->flush_mutex);
+
+	if (handle) {
+		cancel_delayed_work(&fbP->splash_work);
+		men_16z044_SurfFree(fbP, handle, NULL);
+		DPRINTK("%s: splash hidden\n", fbP->name);
+	}
+}
+
+/**********************************************************************/
+/** delayed work, hides the boot splash after splash_ms
+ *
+ * \param \IN    work   work_struct embedded in fbP->splash_work
+ */
+static void men_16z044_SplashWork(struct work_struct *work)
+{
+	struct MEN_16Z044_FB *fbP =
+		container_of(work, struct MEN_16Z044_FB, splash_work.work);
+
+	men_16z044_SplashHide(fbP);
+}
+
+/**********************************************************************/
+/** fb_open, the first client of the fb device ends the boot splash
+ *
+ * \param \IN    info   fb_info of the display
+ * \param \IN    user   0 for fbcon, 1 for an open of the device file
+ *
+ * \returns 0
+ */
+static int men_16z044_open(struct fb_info *info, int user)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+
+	if (!fbP || !user)
+		return 0;
+
+	if (READ_ONCE(fbP->splash_handle))
+		men_16z044_SplashHide(fbP);
+
+	mutex_lock(&fbP->vram_lock);
+	fbP->vram_users++;
+	mutex_unlock(&fbP->vram_lock);
+	men_16z044_SurfReap(fbP, 0);
+	return 0;
+}
+
+/**********************************************************************/
+/** fb_release, frees the surfaces of clients that are gone
+ *
+ * \param \IN    info   fb_info of the display
+ * \param \IN    user   0 for fbcon, 1 for a close of the device file
+ *
+ * \returns 0
+ */
+static int men_16z044_release(struct fb_info *info, int user)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+	int last;
+
+	if (!fbP || !user)
+		return 0;
+
+	mutex_lock(&fbP->vram_lock);
+	last = !--fbP->vram_users;
+	mutex_unlock(&fbP->vram_lock);
+	men_16z044_SurfReap(fbP, last);
+	return 0;
+}
+
+/**********************************************************************/
+/** execute one of the 16z044 specific ioctls
+ *
+ * \param \IN  fbP   pointer to struct of 16z044 data
+ * \param \IN  cmd
+ * \param \IN  arg
+ *
+ * \returns Errorcode if error  or 0 on success
+ */
+static int men_16z044_DoIoctl(struct MEN_16Z044_FB *fbP, unsigned int cmd,
+                              unsigned long arg)
+{
+	struct fb_info *info = &fbP->info;
+	unsigned int scrnr = 0;
+	struct men_16z044_surface surf;
+	struct men_16z044_surf_upload upload;
+	struct men_16z044_surf_blit blit;
+	struct men_16z044_anim anim;
+	struct pid *owner = task_tgid(current);
+	int ret;
+
+	switch (cmd) {
+	case FBIO_ENABLE_MEN_16Z044_TEST:
+		DPRINTK("ioctl FBIO_ENABLE_MEN_16Z044_TEST\n");
+		return men_16z044_EnableTestMode(fbP, 1);
+
+	case FBIO_DISABLE_MEN_16Z044_TEST:
+		DPRINTK("ioctl FBIO_DISABLE_MEN_16Z044_TEST\n");
+		return men_16z044_EnableTestMode(fbP, 0);
+
+	case FBIO_ENABLE_75HZ:
+		DPRINTK("ioctl FBIO_ENABLE_75HZ\n");
+		return men_16z044_SetWantedRate(fbP, 75);
+
+	case FBIO_ENABLE_60HZ:
+		DPRINTK("ioctl FBIO_ENABLE_60HZ\n");
+		return men_16z044_SetWantedRate(fbP, 60);
+
+	case FBIO_MEN_16Z044_RES_640X480:
+	case FBIO_MEN_16Z044_RES_800X600:
+	case FBIO_MEN_16Z044_RES_1024X768:
+	case FBIO_MEN_16Z044_RES_1280X1024:
+		DPRINTK("ioctl FBIO_MEN_16Z044_RES_*\n");
+		return men_16z044_SwitchRes(fbP, _IOC_NR(cmd) -
+		                            _IOC_NR(FBIO_MEN_16Z044_RES_640X480));
+
+	case FBIO_MEN_16Z044_SWAP_ON:
+		DPRINTK("ioctl FBIO_MEN_16Z044_SWAP_ON\n");
+		return men_16z044_ByteSwap(fbP, 1);
+
+	case FBIO_MEN_16Z044_SWAP_OFF:
+		DPRINTK("ioctl FBIO_MEN_16Z044_SWAP_OFF\n");
+		return men_16z044_ByteSwap(fbP, 0);
+
+	case FBIO_MEN_16Z044_BLANK:
+		DPRINTK("ioctl FBIO_MEN_16Z044_BLANK\n");
+		return men_16z044_fb_blank(FB_BLANK_NORMAL, info);
+
+	case FBIO_MEN_16Z044_UNBLANK:
+		DPRINTK("ioctl FBIO_MEN_16Z044_UNBLANK\n");
+		return men_16z044_fb_blank(FB_BLANK_UNBLANK, info);
+
+	case FBIO_MEN_16Z044_SET_SCREEN:
+		if(copy_from_user((void*)&scrnr, (void*)arg, sizeof(scrnr))){
+			printk(KERN_ERR "*** error: copy_from_user _SET_SCREEN \n");
+		}
+		DPRINTK("ioctl FBIO_MEN_16Z044_SET_SCREEN. nr: %d\n", scrnr);
+		return men_16z044_SetScreen(fbP, scrnr);
+
+	case FBIO_MEN_16Z044_SURF_ALLOC:
+		if (copy_from_user(&surf, (void __user *)arg, sizeof(surf)))
+			return -EFAULT;
+		ret = men_16z044_SurfAlloc(fbP, &surf, owner);
+		if (!ret && copy_to_user((void __user *)arg, &surf,
+		                         sizeof(surf))) {
+			men_16z044_SurfFree(fbP, surf.handle, owner);
+			ret = -EFAULT;
+		}
+		return ret;
+
+	case FBIO_MEN_16Z044_SURF_FREE:
+		if (copy_from_user(&scrnr, (void __user *)arg, sizeof(scrnr)))
+			return -EFAULT;
+		return men_16z044_SurfFree(fbP, scrnr, owner);
+
+	case FBIO_MEN_16Z044_SURF_UPLOAD:
+		if (copy_from_user(&upload, (void __user *)arg, sizeof(upload)))
+			return -EFAULT;
+		return men_16z044_SurfUpload(fbP, &upload, owner);
+
+	case FBIO_MEN_16Z044_SURF_BLIT:
+		if (copy_from_user(&blit, (void __user *)arg, sizeof(blit)))
+			return -EFAULT;
+		return men_16z044_SurfBlit(fbP, &blit, owner);
+
+	case FBIO_MEN_16Z044_ANIM_START:
+		if (copy_from_user(&anim, (void __user *)arg, sizeof(anim)))
+			return -EFAULT;
+		return men_16z044_AnimStart(fbP, &anim, owner);
+
+	case FBIO_MEN_16Z044_ANIM_STOP:
+		return men_16z044_AnimStop(fbP);
+
+	default:
+		return -EINVAL;
+	}
+}
+
+/**********************************************************************/
+/** Support specific Hardware Functions via ioctls
+ *
+ * \param \IN  info
+ * \param \IN  cmd
+ * \param \IN  arg
+ *
+ * \returns Errorcode if error  or 0 on success
+ */
+static int men_16z044_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg)
+{
+	struct MEN_16Z044_FB *fbP;
+	ktime_t t0 = ktime_get();
+	int ret;
+
+	fbP = men_16z044_from_info(info);
+	if (!fbP)
+		return -EINVAL;
+
+	trace_fb16z044_ioctl_enter(fbP->name, cmd, arg);
+	ret = men_16z044_DoIoctl(fbP, cmd, arg);
+	trace_fb16z044_ioctl_exit(fbP->name, cmd, ret);
+	men_16z044_StatOp(fbP, MEN_16Z044_OP_IOCTL, t0);
+
+	return ret;
+}
+
+#ifdef MEN_16Z044_MOCK
+/**********************************************************************/
+/** mmap the vmalloc'ed SDRAM of the mock device
+ *
+ * \param \IN  info
+ * \param \IN  vma   user mapping to set up
+ *
+ * \returns Errorcode if error  or 0 on success
+ */
+static int men_16z044_MockMmap(struct fb_info *info, struct vm_area_struct *vma)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_info(info);
+
+	return remap_vmalloc_range(vma, fbP->sdram_virt, vma->vm_pgoff);
+}
+#endif
+
+extern int soft_cursor(struct fb_info *info, struct fb_cursor *cursor);
+static struct fb_ops men_16z044_ops = {
+	.fb_open        = men_16z044_open,
+	.fb_release     = men_16z044_release,
+	.fb_check_var   = men_16z044_check_var,
+	.fb_set_par     = men_16z044_set_par,
+	.fb_setcolreg   = men_16z044_setcolreg,
+	.fb_setcmap     = men_16z044_setcmap,
+	.fb_pan_display = men_16z044_pan_display,
+	.fb_blank       = men_16z044_fb_blank,
+	.fb_fillrect    = men_16z044_fillrect,
+	.fb_copyarea    = men_16z044_copyarea,
+	.fb_imageblit   = men_16z044_imageblit,
+#ifdef MEN_16Z044_MOCK
+	.fb_mmap        = men_16z044_MockMmap,
+#endif
+#ifdef CONFIG_FRAMEBUFFER_CONSOLE
+	.fb_cursor      = soft_cursor,
+#endif /*CONFIG_FRAMEBUFFER_CONSOLE*/
+	/* perform fb specific ioctl (optional) */
+	.fb_ioctl       = men_16z044_ioctl,
+};
+
+/* drawing into the system RAM shadow, SDRAM is updated by flushes */
+static struct fb_ops men_16z044_shadow_ops = {
+	.fb_read        = fb_sys_read,
+	.fb_write       = men_16z044_sh_write,
+	.fb_open        = men_16z044_open,
+	.fb_release     = men_16z044_release,
+	.fb_check_var   = men_16z044_check_var,
+	.fb_set_par     = men_16z044_set_par,
+	.fb_setcolreg   = men_16z044_setcolreg,
+	.fb_setcmap     = men_16z044_setcmap,
+	.fb_pan_display = men_16z044_pan_display,
+	.fb_blank       = men_16z044_fb_blank,
+	.fb_fillrect    = men_16z044_fillrect,
+	.fb_copyarea    = men_16z044_copyarea,
+	.fb_imageblit   = men_16z044_imageblit,
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,2,0)
+	.fb_mmap        = fb_deferred_io_mmap,
+#endif
+#ifdef CONFIG_FRAMEBUFFER_CONSOLE
+	.fb_cursor      = soft_cursor,
+#endif /*CONFIG_FRAMEBUFFER_CONSOLE*/
+	.fb_ioctl       = men_16z044_ioctl,
+};
+
+/*-----------------------------------------------------------------------+
+ |  sysfs attributes of the fb device                                     |
+ +-----------------------------------------------------------------------*/
+static struct MEN_16Z044_FB *men_16z044_from_dev(struct device *dev)
+{
+	return men_16z044_from_info((struct fb_info *)dev_get_drvdata(dev));
+}
+
+#define MEN_16Z044_ATTR_UINT(_name, _min, _max)                          \
+static ssize_t _name##_show(struct device *dev,                          \
+                            struct device_attribute *attr, char *buf)    \
+{                                                                        \
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);            \
+	return sprintf(buf, "%u\n", fbP->_name);                         \
+}                                                                        \
+static ssize_t _name##_store(struct device *dev,                         \
+                             struct device_attribute *attr,              \
+                             const char *buf, size_t count)              \
+{                                                                        \
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);            \
+	unsigned int val;                                                \
+	if (kstrtouint(buf, 0, &val) || val < (_min) || val > (_max))    \
+		return -EINVAL;                                          \
+	fbP->_name = val;                                                \
+	return count;                                                    \
+}                                                                        \
+static DEVICE_ATTR(_name, 0644, _name##_show, _name##_store)
+
+MEN_16Z044_ATTR_UINT(flush_band,    0, 0xffff);
+MEN_16Z044_ATTR_UINT(flush_workers, 1, MEN_16Z044_MAX_FLUSHERS);
+MEN_16Z044_ATTR_UINT(flush_mt_min,  0, UINT_MAX);
+
+static ssize_t flush_stats_show(struct device *dev,
+                                struct device_attribute *attr, char *buf)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);
+	static const char *mode[] = { "single", "parallel" };
+	int i, n = 0;
+
+	/* bytes/us is MB/s */
+	for (i = 0; i < 2; i++)
+		n += sprintf(buf + n, "%-8s count %lu bytes %llu ns %llu MB/s %llu\n",
+		             mode[i], fbP->flush_count[i],
+		             (unsigned long long)fbP->flush_bytes[i],
+		             (unsigned long long)fbP->flush_ns[i],
+		             (unsigned long long)div64_u64(fbP->flush_bytes[i] * 1000,
+		                                           fbP->flush_ns[i] + 1));
+	return n;
+}
+static DEVICE_ATTR(flush_stats, 0444, flush_stats_show, NULL);
+
+/* FB_ROTATE_* of the screen: 0, 1 (90 cw), 2 (180) or 3 (90 ccw) */
+static ssize_t rotate_show(struct device *dev,
+                           struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", men_16z044_from_dev(dev)->rotate);
+}
+
+static ssize_t rotate_store(struct device *dev,
+                            struct device_attribute *attr,
+                            const char *buf, size_t count)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);
+	unsigned int val;
+	int ret;
+
+	if (kstrtouint(buf, 0, &val) || val > FB_ROTATE_CCW)
+		return -EINVAL;
+
+	ret = men_16z044_SetRotate(fbP, val);
+	return ret ? ret : count;
+}
+static DEVICE_ATTR(rotate, 0644, rotate_show, rotate_store);
+
+static struct device_attribute *G_shadowAttrs[] __maybe_unused = {
+	&dev_attr_rotate,
+	&dev_attr_flush_band,
+	&dev_attr_flush_workers,
+	&dev_attr_flush_mt_min,
+	&dev_attr_flush_stats,
+	NULL
+};
+
+/* results of the access calibration of the first instance, '*' marks
+ * the selected routines */
+static ssize_t access_calib_show(struct device *dev,
+                                 struct device_attribute *attr, char *buf)
+{
+	int i, n = 0;
+
+	if (!G_calDone)
+		return sprintf(buf, "not calibrated\n");
+
+	for (i = 0; i < MEN_16Z044_CAL_NUM; i++)
+		if (G_copyFns[i].avail)
+			n += sprintf(buf + n, "%-12s %6u MB/s%s\n",
+			             G_copyFns[i].name, G_calCopy[i],
+			             i == G_calCopySel ? " *" : "");
+	for (i = 0; i < MEN_16Z044_CAL_NUM; i++)
+		if (G_fillFns[i].avail)
+			n += sprintf(buf + n, "%-12s %6u MB/s%s\n",
+			             G_fillFns[i].name, G_calFill[i],
+			             i == G_calFillSel ? " *" : "");
+	return n;
+}
+static DEVICE_ATTR(access_calib, 0444, access_calib_show, NULL);
+
+MEN_16Z044_ATTR_UINT(refresh_burst, 1, 10000);
+MEN_16Z044_ATTR_UINT(refresh_idle,  0, 60000);
+
+/* refresh governor policy, the active one is shown in brackets */
+static ssize_t refresh_policy_show(struct device *dev,
+                                   struct device_attribute *attr, char *buf)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);
+	int i, n = 0;
+
+	for (i = 0; i < MEN_16Z044_GOV_NUM; i++)
+		n += sprintf(buf + n, i == fbP->refresh_policy ? "[%s] " : "%s ",
+		             G_govNames[i]);
+	buf[n - 1] = '\n';
+	return n;
+}
+
+static ssize_t refresh_policy_store(struct device *dev,
+                                    struct device_attribute *attr,
+                                    const char *buf, size_t count)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);
+	int i;
+
+	for (i = 0; i < MEN_16Z044_GOV_NUM; i++) {
+		if (sysfs_streq(buf, G_govNames[i])) {
+			fbP->refresh_policy = i;
+			fbP->gov_quiet = 0;
+			mod_delayed_work(system_wq, &fbP->gov_work, 0);
+			return count;
+		}
+	}
+	return -EINVAL;
+}
+static DEVICE_ATTR(refresh_policy, 0644, refresh_policy_show,
+                   refresh_policy_store);
+
+static ssize_t refresh_hz_show(struct device *dev,
+                               struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", men_16z044_from_dev(dev)->hw_rate);
+}
+static DEVICE_ATTR(refresh_hz, 0444, refresh_hz_show, NULL);
+
+/* idle blank timeout in s, 0 disables it */
+static ssize_t idle_blank_show(struct device *dev,
+                               struct device_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", men_16z044_from_dev(dev)->idle_blank);
+}
+
+static ssize_t idle_blank_store(struct device *dev,
+                                struct device_attribute *attr,
+                                const char *buf, size_t count)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);
+	unsigned int val;
 
-	if (!fbP)
-		return;
+	if (kstrtouint(buf, 0, &val) || val > 24 * 3600)
+		return -EINVAL;
 
-	ctrl = readl(fb_men_16z044_DispCtrlBase(fbP));
+	fbP->idle_blank = val;
+	if (val) {
+		WRITE_ONCE(fbP->idle_stamp, jiffies);
+		mod_delayed_work(system_wq, &fbP->idle_work, val * HZ);
+	} else {
+		cancel_delayed_work_sync(&fbP->idle_work);
+		men_16z044_IdleWake(fbP);
+	}
+	return count;
+}
+static DEVICE_ATTR(idle_blank, 0644, idle_blank_show, idle_blank_store);
 
-	if (!!blank)
-		ctrl |= Z044_DISP_CTRL_ONOFF;
-	else
-		ctrl &= ~Z044_DISP_CTRL_ONOFF;
+/* off-screen surface memory: total, free and largest gap in bytes */
+static ssize_t vram_show(struct device *dev, struct device_attribute *attr,
+                         char *buf)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_from_dev(dev);
+	struct MEN_16Z044_SURF *surf;
+	u32 offs, gap = 0, used = 0, n = 0;
+
+	mutex_lock(&fbP->vram_lock);
+	offs = fbP->vram_base;
+	list_for_each_entry(surf, &fbP->surfs, list) {
+		gap   = max(gap, surf->offs - offs);
+		offs  = surf->offs + surf->size;
+		used += surf->size;
+		n++;
+	}
+	gap = max(gap, fbP->sdram_size - offs);
+	mutex_unlock(&fbP->vram_lock);
 
-	/* bit31 must be set to '1' too to let changes take effect. */
-	ctrl |= Z044_DISP_CTRL_CHANGE;
-	writel(ctrl, fb_men_16z044_DispCtrlBase(fbP));
+	return sprintf(buf, "base 0x%x size %u free %u largest %u surfaces %u\n",
+	               fbP->vram_base, fbP->sdram_size - fbP->vram_base,
+	               fbP->sdram_size - fbP->vram_base - used, gap, n);
 }
+static DEVICE_ATTR(vram, 0444, vram_show, NULL);
 
-/**********************************************************************/
-/** enable/disable the P018 Testpattern (a colored frame at the    edges
- *    of the Screen, determined by the current Resolution)
- *
- * \param \IN    fbP    pointer to struct of 16z044 data
- * \param \IN    en    1: test pattern on  0: disable it
- *
- * \returns  if success / negative errorcode on error
- */
-static int men_16z044_EnableTestMode(struct MEN_16Z044_FB *fbP, unsigned int en)
+/* boot splash shown, writing 0 hides it */
+static ssize_t splash_show(struct device *dev, struct device_attribute *attr,
+                           char *buf)
 {
-	unsigned int ctrl = 0;
-	if (!fbP)
-		return -EINVAL;
+	return sprintf(buf, "%u\n",
+	               !!READ_ONCE(men_16z044_from_dev(dev)->splash_handle));
+}
 
-	if (!fbP->dispctr_virt)
+static ssize_t splash_store(struct device *dev, struct device_attribute *attr,
+                            const char *buf, size_t count)
+{
+	unsigned int val;
+
+	if (kstrtouint(buf, 0, &val) || val)
 		return -EINVAL;
+	men_16z044_SplashHide(men_16z044_from_dev(dev));
+	return count;
+}
+static DEVICE_ATTR(splash, 0644, splash_show, splash_store);
+
+static struct device_attribute *G_devAttrs[] __maybe_unused = {
+	&dev_attr_access_calib,
+	&dev_attr_vram,
+	&dev_attr_splash,
+	&dev_attr_refresh_policy,
+	&dev_attr_refresh_burst,
+	&dev_attr_refresh_idle,
+	&dev_attr_refresh_hz,
+	&dev_attr_idle_blank,
+	NULL
+};
 
-	ctrl = readl(fb_men_16z044_DispCtrlBase(fbP));
-	if (!!en)
-		ctrl |= Z044_DISP_CTRL_DEBUG;
-	else
-		ctrl &= ~Z044_DISP_CTRL_DEBUG;
+/*-----------------------------------------------------------------------+
+ |  debugfs statistics, /sys/kernel/debug/fb16z044_<n>/                   |
+ +-----------------------------------------------------------------------*/
+static const char *G_statNames[MEN_16Z044_ST_NUM] = {
+	"mmio_reads", "mmio_writes", "sdram_write_bytes", "sdram_read_bytes",
+	"refresh_switches"
+};
 
-	writel(ctrl, fb_men_16z044_DispCtrlBase(fbP));
-	return 0;
-}
+static const char *G_opNames[MEN_16Z044_OP_NUM] = {
+	"fillrect", "copyarea", "imageblit", "flush", "ioctl",
+	"setcolreg", "write", "deferred_io", "setcmap"
+};
 
 /**********************************************************************/
-/** Switch the refresh rate between 60 Hz and 75Hz. (currently) only
- *  these Values are supported in the 16z044.
+/** sum up the statistics of all CPUs
  *
  * \param \IN    fbP    pointer to struct of 16z044 data
- * \param \IN    rate   Value in Hz to set. currently just 60 or 75.
- *
- *
- * \returns 0 if success / negative errorcode on error
+ * \param \OUT   sum    statistics of all CPUs
  */
-static int men_16z044_SetRefreshRate(struct MEN_16Z044_FB *fbP, unsigned int rate)
+static void men_16z044_StatSum(struct MEN_16Z044_FB *fbP,
+                               struct MEN_16Z044_STATS *sum)
 {
-	unsigned int ctrl = 0;
-
-	if (!fbP)
-		return -EINVAL;
-
-	ctrl = readl(fb_men_16z044_DispCtrlBase(fbP));
-	switch (rate) {
-	case MEN_16Z044_REFRESH_75HZ:
-		DPRINTK("setting 75 Hz\n");
-		ctrl |= Z044_DISP_CTRL_REFRESH;
-		break;
-	case MEN_16Z044_REFRESH_60HZ:
-		DPRINTK("setting 60 Hz\n");
-		ctrl &= ~Z044_DISP_CTRL_REFRESH;
-		break;
-	default:
-		return -EINVAL;
+	struct MEN_16Z044_STATS *st;
+	int cpu, i, j;
+
+	memset(sum, 0, sizeof(*sum));
+	for_each_possible_cpu(cpu) {
+		st = per_cpu_ptr(fbP->stats, cpu);
+		for (i = 0; i < MEN_16Z044_ST_NUM; i++)
+			sum->cnt[i] += st->cnt[i];
+		for (i = 0; i < MEN_16Z044_OP_NUM; i++)
+			sum->calls[i] += st->calls[i];
+		for (i = 0; i < MEN_16Z044_OP_LAT_NUM; i++)
+			for (j = 0; j < MEN_16Z044_LAT_BUCKETS; j++)
+				sum->lat[i][j] += st->lat[i][j];
 	}
-	ctrl |= Z044_DISP_CTRL_CHANGE;
-	writel(ctrl, fb_men_16z044_DispCtrlBase(fbP));
-
-	return 0;
 }
 
-/**********************************************************************/
-/**  Readout the current Resolution thats set in HW
- *
- * \param \IN    fbP    pointer to struct of 16z044 data
- *
- * \returns (0,1,2,3) as resolution if success or negative errorcode
- *
- */
-static int men_16z044_GetResolution(struct MEN_16Z044_FB *fbP)
+static int men_16z044_StatsShow(struct seq_file *m, void *v)
 {
-	unsigned int res = 0;
-	if (!fbP)
-		return -EINVAL;
+	struct MEN_16Z044_FB *fbP = m->private;
+	struct MEN_16Z044_STATS *sum;
+	int i;
 
-	res = readl(fb_men_16z044_DispCtrlBase(fbP)) & 0x3;
-	printk(KERN_INFO "16Z044 found. Resolution: %d x %d\n",
-			G_resol[res].xres, G_resol[res].yres);
-	return res;
+	sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+	men_16z044_StatSum(fbP, sum);
+
+	for (i = 0; i < MEN_16Z044_ST_NUM; i++)
+		seq_printf(m, "%-20s %llu\n", G_statNames[i],
+		           (unsigned long long)sum->cnt[i]);
+	for (i = 0; i < MEN_16Z044_OP_NUM; i++)
+		seq_printf(m, "calls_%-14s %llu\n", G_opNames[i],
+		           (unsigned long long)sum->calls[i]);
+
+	kfree(sum);
+	return 0;
 }
 
-/**********************************************************************/
-/**  Set byte swapping of the 16bpp value according to architecture
- *
- * \param \IN    fbP    pointer to struct of 16z044 data
- * \param \IN    en     1 to swap bytes (PPC), 0 to not swap bytes
- *
- * \returns 0 if success / negative errorcode on error
- */
-static int men_16z044_ByteSwap(struct MEN_16Z044_FB *fbP, unsigned int en)
+static int men_16z044_LatencyShow(struct seq_file *m, void *v)
 {
-	unsigned int ctrl = 0;
-	DPRINTK("men_16z044_ByteSwap: en = %d\n", en);
-
-	if (!fbP)
-		return -EINVAL;
+	struct MEN_16Z044_FB *fbP = m->private;
+	struct MEN_16Z044_STATS *sum;
+	int i, j;
 
-	ctrl = readl(fb_men_16z044_DispCtrlBase(fbP));
-	/* set to 0 first */
-	ctrl &= ~Z044_DISP_CTRL_BYTESWAP;
-	if (!!en)
-		ctrl |= Z044_DISP_CTRL_BYTESWAP;
-	writel(ctrl, fb_men_16z044_DispCtrlBase(fbP));
+	sum = kmalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+	men_16z044_StatSum(fbP, sum);
+
+	/* bucket j holds durations in [2^(j-1), 2^j) ns */
+	for (i = 0; i < MEN_16Z044_OP_LAT_NUM; i++) {
+		seq_printf(m, "%s:\n", G_opNames[i]);
+		for (j = 0; j < MEN_16Z044_LAT_BUCKETS; j++) {
+			if (!sum->lat[i][j])
+				continue;
+			seq_printf(m, "  %10llu .. %10llu ns: %llu\n",
+			           j ? 1ULL << (j - 1) : 0ULL, 1ULL << j,
+			           (unsigned long long)sum->lat[i][j]);
+		}
+	}
 
+	kfree(sum);
 	return 0;
+}
 
+static int men_16z044_StatsOpen(struct inode *inode, struct file *file)
+{
+	return single_open(file, men_16z044_StatsShow, inode->i_private);
 }
 
-/**********************************************************************/
-/**  Switch flat panel on / off
- *
- * \param \IN    fbP    pointer to struct of 16z044 data
- * \param \IN    en     0 to swap bytes, 1 to not swap bytes (PPC)
- *
- * \returns 0 if success / negative errorcode on error
- */
-static int men_16z044_FlatPanel(struct MEN_16Z044_FB *fbP, unsigned int en)
+static int men_16z044_LatencyOpen(struct inode *inode, struct file *file)
 {
-	unsigned int ctrl = 0;
+	return single_open(file, men_16z044_LatencyShow, inode->i_private);
+}
 
-	if (!fbP)
-		return -EINVAL;
+static ssize_t men_16z044_ResetWrite(struct file *file, const char __user *buf,
+                                     size_t count, loff_t *ppos)
+{
+	struct MEN_16Z044_FB *fbP = file->private_data;
+	int cpu;
 
-	ctrl = readl(fb_men_16z044_DispCtrlBase(fbP) + MEN_16Z044_FP_CTRL);
-	/* set to 0 first */
-	ctrl &= ~(0x7);
-	if (!!en)
-		ctrl |= (0x7);
-	writel(ctrl, fb_men_16z044_DispCtrlBase(fbP) + MEN_16Z044_FP_CTRL);
+	for_each_possible_cpu(cpu)
+		memset(per_cpu_ptr(fbP->stats, cpu), 0,
+		       sizeof(struct MEN_16Z044_STATS));
 
-	return 0;
+	mutex_lock(&fbP->flush_mutex);
+	memset(fbP->flush_count, 0, sizeof(fbP->flush_count));
+	memset(fbP->flush_bytes, 0, sizeof(fbP->flush_bytes));
+	memset(fbP->flush_ns,    0, sizeof(fbP->flush_ns));
+	mutex_unlock(&fbP->flush_mutex);
+
+	return count;
 }
 
 /**********************************************************************/
-/** Support specific Hardware Functions via ioctls
- *
- * \param \IN  info
- * \param \IN  cmd
- * \param \IN  arg
+/** read (and consume) the capture: header at offset 0, then records
  *
- * \returns Errorcode if error  or 0 on success
+ * \brief  Only whole records are returned, 'cat capture > file' gives a
+ *         file for the fb16z044_replay tool.
  */
-static int men_16z044_ioctl(struct fb_info *info, unsigned int cmd, unsigned long arg)
+static ssize_t men_16z044_CaptureRead(struct file *file, char __user *buf,
+                                      size_t count, loff_t *ppos)
 {
-	struct MEN_16Z044_FB *fbP;
-	unsigned int scrnr = 0;
-
-	fbP = men_16z044_from_info(info);
-	if (!fbP)
-		return -EINVAL;
+	struct MEN_16Z044_FB *fbP = file->private_data;
+	struct men_16z044_cap_hdr hdr;
+	struct men_16z044_cap_rec rec;
+	unsigned long flags;
+	size_t done = 0;
+
+	if (*ppos == 0) {
+		if (count < sizeof(hdr))
+			return -EINVAL;
+		memset(&hdr, 0, sizeof(hdr));
+		hdr.magic           = MEN_16Z044_CAP_MAGIC;
+		hdr.version         = MEN_16Z044_CAP_VERSION;
+		hdr.xres            = G_resol[fbP->res].xres;
+		hdr.yres            = G_resol[fbP->res].yres;
+		hdr.line_length     = fbP->hw_line_length;
+		/* SDRAM layout, rounded up for packed pixels */
+		hdr.bytes_per_pixel =
+			DIV_ROUND_UP(G_resol[fbP->res].bits_per_pixel, 8);
+		hdr.sdram_size      = fbP->sdram_size;
+		hdr.lost            = fbP->cap_lost;
+		if (copy_to_user(buf, &hdr, sizeof(hdr)))
+			return -EFAULT;
+		done = sizeof(hdr);
+	}
 
-	switch (cmd) {
-	case FBIO_ENABLE_MEN_16Z044_TEST:
-		DPRINTK("ioctl FBIO_ENABLE_MEN_16Z044_TEST\n");
-		return men_16z044_EnableTestMode(fbP, 1);
+	while (count - done >= sizeof(rec)) {
+		spin_lock_irqsave(&fbP->cap_lock, flags);
+		if (fbP->cap_tail == fbP->cap_head) {
+			spin_unlock_irqrestore(&fbP->cap_lock, flags);
+			break;
+		}
+		rec = fbP->cap[fbP->cap_tail];
+		fbP->cap_tail = (fbP->cap_tail + 1) % fbP->cap_size;
+		spin_unlock_irqrestore(&fbP->cap_lock, flags);
 
-	case FBIO_DISABLE_MEN_16Z044_TEST:
-		DPRINTK("ioctl FBIO_DISABLE_MEN_16Z044_TEST\n");
-		return men_16z044_EnableTestMode(fbP, 0);
+		if (copy_to_user(buf + done, &rec, sizeof(rec)))
+			return done ? done : -EFAULT;
+		done += sizeof(rec);
+	}
 
-	case FBIO_ENABLE_75HZ:
-		DPRINTK("ioctl FBIO_ENABLE_75HZ\n");
-		return men_16z044_SetRefreshRate(fbP, 75);
+	*ppos += done;
+	return done;
+}
 
-	case FBIO_ENABLE_60HZ:
-		DPRINTK("ioctl FBIO_ENABLE_60HZ\n");
-		return men_16z044_SetRefreshRate(fbP, 60);
+static const struct file_operations G_captureFops = {
+	.owner   = THIS_MODULE,
+	.open    = simple_open,
+	.read    = men_16z044_CaptureRead,
+#if LINUX_VERSION_CODE < KERNEL_VERSION(6,12,0)
+	.llseek  = no_llseek,
+#endif
+};
 
-	case FBIO_MEN_16Z044_SWAP_ON:
-		DPRINTK("ioctl FBIO_MEN_16Z044_SWAP_ON\n");
-		return men_16z044_ByteSwap(fbP, 1);
+static const struct file_operations G_statsFops = {
+	.owner   = THIS_MODULE,
+	.open    = men_16z044_StatsOpen,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
 
-	case FBIO_MEN_16Z044_SWAP_OFF:
-		DPRINTK("ioctl FBIO_MEN_16Z044_SWAP_OFF\n");
-		return men_16z044_ByteSwap(fbP, 0);
+static const struct file_operations G_latencyFops = {
+	.owner   = THIS_MODULE,
+	.open    = men_16z044_LatencyOpen,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
 
-	case FBIO_MEN_16Z044_BLANK:
-		DPRINTK("ioctl FBIO_MEN_16Z044_BLANK\n");
-		men_16z044_blank(1, info);
-		return 0;
+static const struct file_operations G_resetFops = {
+	.owner   = THIS_MODULE,
+	.open    = simple_open,
+	.write   = men_16z044_ResetWrite,
+};
 
-	case FBIO_MEN_16Z044_UNBLANK:
-		DPRINTK("ioctl FBIO_MEN_16Z044_UNBLANK\n");
-		men_16z044_blank(0, info);
-		return 0;
+/**********************************************************************/
+/** create the debugfs directory of this instance
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void __maybe_unused men_16z044_DebugfsInit(struct MEN_16Z044_FB *fbP)
+{
+#ifdef CONFIG_DEBUG_FS
+	if (!fbP->stats)
+		return;
 
-	case FBIO_MEN_16Z044_SET_SCREEN:
-		if(copy_from_user((void*)&scrnr, (void*)arg, sizeof(scrnr))){
-			printk(KERN_ERR "*** error: copy_from_user _SET_SCREEN \n");
+	fbP->debugfs = debugfs_create_dir(fbP->name, NULL);
+	if (IS_ERR_OR_NULL(fbP->debugfs)) {
+		fbP->debugfs = NULL;
+		return;
+	}
+	debugfs_create_file("stats",   0444, fbP->debugfs, fbP, &G_statsFops);
+	debugfs_create_file("latency", 0444, fbP->debugfs, fbP, &G_latencyFops);
+	debugfs_create_file("reset",   0200, fbP->debugfs, fbP, &G_resetFops);
+
+	if (capture) {
+		spin_lock_init(&fbP->cap_lock);
+		/* one slot stays free, head == tail is the empty ring */
+		fbP->cap_size = min_t(unsigned int, capture,
+		                      MEN_16Z044_CAP_MAX) + 1;
+		fbP->cap = vzalloc(array_size(fbP->cap_size,
+		                              sizeof(struct men_16z044_cap_rec)));
+		if (!fbP->cap) {
+			printk(KERN_WARNING "%s: no memory for capture\n", fbP->name);
+			return;
 		}
-		DPRINTK("ioctl FBIO_MEN_16Z044_SET_SCREEN. nr: %d\n", scrnr);
-		return men_16z044_SetScreen(fbP, scrnr);
-
-	default:
-		return -EINVAL;
+		fbP->cap_on   = 1;
+		debugfs_create_file("capture", 0400, fbP->debugfs, fbP,
+		                    &G_captureFops);
+		debugfs_create_u32("capture_on", 0600, fbP->debugfs, &fbP->cap_on);
 	}
+#endif
 }
 
-extern int soft_cursor(struct fb_info *info, struct fb_cursor *cursor);
-static struct fb_ops men_16z044_ops = {
-	.fb_setcolreg   = men_16z044_setcolreg,
-	.fb_pan_display = men_16z044_pan_display,
-	.fb_fillrect    = cfb_fillrect,
-	.fb_copyarea    = cfb_copyarea,
-	.fb_imageblit   = cfb_imageblit,
-#ifdef CONFIG_FRAMEBUFFER_CONSOLE
-	.fb_cursor      = soft_cursor,
-#endif /*CONFIG_FRAMEBUFFER_CONSOLE*/
-	/* perform fb specific ioctl (optional) */
-	.fb_ioctl       = men_16z044_ioctl,
-};
+/**********************************************************************/
+/** create/remove the sysfs attributes of a list
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ * \param \IN    attrs  NULL terminated list of attributes
+ * \param \IN    add    1 to create, 0 to remove the attributes
+ */
+static void __maybe_unused men_16z044_SysfsAttrs(struct MEN_16Z044_FB *fbP,
+                                  struct device_attribute **attrs, int add)
+{
+	if (!fbP->info.dev)
+		return;
+
+	for (; *attrs; attrs++) {
+		if (!add)
+			device_remove_file(fbP->info.dev, *attrs);
+		else if (device_create_file(fbP->info.dev, *attrs))
+			printk(KERN_WARNING "%s: can't create sysfs file %s\n",
+			       fbP->name, (*attrs)->attr.name);
+	}
+}
 
 /**********************************************************************/
 /** Init the Addresses and remapped Spaces of the FB
@@ -566,9 +4156,14 @@ static unsigned int men_16z044_MapAdresses(struct MEN_16Z044_FB *fbP)
 	/*------------------------------+
 	 | map 16Z043_SDRAM unit        |
 	 +------------------------------*/
+#ifdef MEN_16Z044_MOCK
+	fbP->sdram_virt  = men_16z044_mock_bar(fbP->pdev, fbP->barSdram,
+	                                       &fbP->sdram_phys, &fbP->sdram_size);
+#else
 	fbP->sdram_phys  = pci_resource_start(fbP->pdev, fbP->barSdram);
 	fbP->sdram_size  = pci_resource_len(fbP->pdev, fbP->barSdram);
 	fbP->sdram_virt  = ioremap(fbP->sdram_phys, fbP->sdram_size);
+#endif
 	fbP->mmio_start  = fbP->sdram_phys; /* needed in fb subsystem */
 	fbP->mmio_len    = fbP->sdram_size;
 	DPRINTK("fbP->sdram_phys=0x%08x ->sdram_size=0x%08x ->sdram_virt=%p\n",
@@ -577,9 +4172,15 @@ static unsigned int men_16z044_MapAdresses(struct MEN_16Z044_FB *fbP)
 	/*------------------------------+
 	 | map 16Z044_DISP unit         |
 	 +------------------------------*/
+#ifdef MEN_16Z044_MOCK
+	fbP->dispctr_virt  = men_16z044_mock_bar(fbP->pdev, fbP->barDisp,
+	                                         &fbP->dispctr_phys,
+	                                         &fbP->dispctr_size);
+#else
 	fbP->dispctr_phys  = pci_resource_start(fbP->pdev, fbP->barDisp);
 	fbP->dispctr_size  = pci_resource_len(fbP->pdev, fbP->barDisp);
 	fbP->dispctr_virt  = ioremap(fbP->dispctr_phys, fbP->dispctr_size);
+#endif
 	DPRINTK("fbP->dispctr_phys=0x%08x fbP->dispctr_size=0x%08x\n",
 			fbP->dispctr_phys, fbP->dispctr_size);
 
@@ -594,25 +4195,10 @@ static unsigned int men_16z044_MapAdresses(struct MEN_16Z044_FB *fbP)
 static void men_16z044_InitVarFb(struct MEN_16Z044_FB *fbP)
 {
 	fbP->var.xres           = fbP->var.xres_virtual = fbP->xres;
-	fbP->var.yres           = fbP->var.yres_virtual = fbP->yres ;
-	fbP->var.bits_per_pixel = 16;
-	fbP->var.grayscale      = 0;    /* != 0 Graylevels instead of colors */
-	fbP->bytes_per_pixel    = 2;
-	switch (fbP->var.bits_per_pixel) {
-	case 15:/* 32k */
-	case 16:
-		fbP->var.red.offset   = 11;
-		fbP->var.red.length   = 5;
-		fbP->var.green.offset = 5;
-		fbP->var.green.length = 6;
-		fbP->var.blue.offset  = 0;
-		fbP->var.blue.length  = 5;
-		break;
-	default:/* not supported (yet) */
-		printk(KERN_ERR "no support for %dbpp\n",fbP->var.bits_per_pixel);
-		/* fbP->disp.dispsw = &fbcon_dummy;   /\* ??? *\/ */
-		break;
-	}
+	fbP->var.yres           = fbP->yres;
+	fbP->var.yres_virtual   = fbP->yres_virtual;
+	fbP->var.bits_per_pixel = fbP->bits_per_pixel;
+	men_16z044_VarColors(&fbP->var);
 
 	fbP->var.nonstd       = 0;     /* != 0 Non standard pixel format      */
 	fbP->var.activate     = 0;     /* see FB_ACTIVATE_*                   */
@@ -639,10 +4225,19 @@ static void men_16z044_InitInfo(struct MEN_16Z044_FB *fbP)
 	fbP->info.fix            = fbP->fix;
 	fbP->info.screen_base    = fbP->sdram_virt;
 	fbP->info.screen_size    = fbP->sdram_size;
-	fbP->info.pseudo_palette = fbP->palette;
+	fbP->info.pseudo_palette = fbP->pseudo_palette;
 
 	fbP->info.flags          = FBINFO_FLAG_DEFAULT;
 	fbP->info.fbops          = &men_16z044_ops;
+	if (fbP->shadow) {
+		fbP->info.screen_base = (char __iomem *)fbP->shadow;
+		fbP->info.screen_size = fbP->shadow_size;
+		fbP->info.flags      |= FBINFO_VIRTFB;
+		fbP->info.fbops       = &men_16z044_shadow_ops;
+	}
+	/* fbcon scrolls by panning and copies within the shadow then */
+	if (fbP->coalesce)
+		fbP->info.flags      |= FBINFO_HWACCEL_YPAN | FBINFO_READS_FAST;
 	fbP->info.node           = -1;
 	/* store address of 'this' 16z044  */
 	fbP->info.par            = (void*)fbP;
@@ -655,18 +4250,104 @@ static void men_16z044_InitFixFb(struct MEN_16Z044_FB *fbP)
 	strcpy(fbP->fix.id, fbP->name);     /* ident string (char[16]) */
 	fbP->fix.type        = FB_TYPE_PACKED_PIXELS; /* see FB_TYPE_* */
 	fbP->fix.type_aux    = 0; /* Interleave for interleaved Planes */
-	fbP->fix.visual      = FB_VISUAL_TRUECOLOR;
+	fbP->fix.visual      = fbP->bits_per_pixel <= 8 ?
+	                       FB_VISUAL_PSEUDOCOLOR : FB_VISUAL_TRUECOLOR;
 	fbP->fix.xpanstep    = 0;
-	fbP->fix.ypanstep    = 0;
+	fbP->fix.ypanstep    = fbP->coalesce ? 1 : 0;
 	fbP->fix.ywrapstep   = 0;
 	fbP->fix.line_length = fbP->line_length; /* len of a line in bytes */
 	fbP->fix.smem_start  = fbP->sdram_phys;
-	fbP->fix.smem_len    = fbP->sdram_size;
+	fbP->fix.smem_len    = fbP->shadow ? fbP->shadow_size : fbP->sdram_size;
 	fbP->fix.mmio_start  = fbP->mmio_start;
 	fbP->fix.mmio_len    = fbP->mmio_len;
 	fbP->fix.accel       = 0;
 }
 
+/**********************************************************************/
+/** allocate the system RAM shadow of the visible screen
+ *
+ * \brief  Drawing and mmap() then work in cached RAM, damaged areas are
+ *         written to SDRAM by men_16z044_Flush(). Large damage is flushed
+ *         by a pool of per-CPU helpers on fbP->flush_wq.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ *
+ * \returns 0 if success / errorcode on error
+ */
+static int men_16z044_InitShadow(struct MEN_16Z044_FB *fbP)
+{
+	int i;
+	u32 bpp = max_t(u32, fbP->bits_per_pixel,
+	                G_resol[fbP->res].bits_per_pixel);
+	u32 size = men_16z044_ResBytes(fbP->res, bpp) *
+	           men_16z044_SdramScreens(fbP, fbP->res);
+
+	/* room for every mode that may be switched to, see SetMode */
+	if (fbP->modeswitch)
+		for (i = 0; i < MEN_16Z044_RES_HW_NUM; i++)
+			if (men_16z044_ResBytes(i, G_resol[i].bits_per_pixel) <=
+			    fbP->sdram_size)
+				size = max(size, men_16z044_ResBytes(i, bpp) *
+				           men_16z044_SdramScreens(fbP, i));
+
+	fbP->shadow_size = PAGE_ALIGN(size);
+	fbP->shadow = vzalloc(fbP->shadow_size);
+	if (!fbP->shadow)
+		return -ENOMEM;
+
+	spin_lock_init(&fbP->damage_lock);
+	INIT_DELAYED_WORK(&fbP->flush_work, men_16z044_FlushWork);
+
+	fbP->flush_band    = flush_band;
+	fbP->flush_workers = clamp_t(unsigned int, flush_workers,
+	                             1, MEN_16Z044_MAX_FLUSHERS);
+	fbP->flush_mt_min  = flush_mt_min;
+	for (i = 0; i < MEN_16Z044_MAX_FLUSHERS; i++) {
+		fbP->flusher[i].fbP = fbP;
+		INIT_WORK(&fbP->flusher[i].work, men_16z044_FlushHelper);
+	}
+	/* no pool needed on a single CPU, flush is done by the caller then */
+	if (num_possible_cpus() > 1)
+		fbP->flush_wq = alloc_workqueue("%s_flush", WQ_HIGHPRI, 0,
+		                                fbP->name);
+
+	fbP->defio.delay       = MEN_16Z044_FLUSH_DELAY;
+	fbP->defio.deferred_io = men_16z044_DeferredIo;
+
+	/* what the SDRAM screen of each VT holds, see FlushRows */
+	if (fbP->vt_screens) {
+		fbP->vt_copy = vmalloc(fbP->vt_screens * fbP->shadow_size);
+		if (!fbP->vt_copy) {
+			printk(KERN_WARNING "%s: no memory for VT screens\n",
+			       fbP->name);
+			fbP->vt_screens = 0;
+		}
+	}
+
+	DPRINTK("%s: shadow %p size 0x%x flush_wq %p\n", fbP->name,
+	        fbP->shadow, fbP->shadow_size, fbP->flush_wq);
+	return 0;
+}
+
+/**********************************************************************/
+/** stop flushing and release the shadow buffer
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void men_16z044_ExitShadow(struct MEN_16Z044_FB *fbP)
+{
+	if (!fbP->shadow)
+		return;
+
+	cancel_delayed_work_sync(&fbP->flush_work);
+	if (fbP->flush_wq)
+		destroy_workqueue(fbP->flush_wq);
+	vfree(fbP->vt_copy);
+	fbP->vt_copy = NULL;
+	vfree(fbP->shadow);
+	fbP->shadow = NULL;
+}
+
 /**********************************************************************/
 /** Init all structs contained in the main 16z044 struct
  *
@@ -717,14 +4398,74 @@ static unsigned int men_16z044_InitDevData(struct MEN_16Z044_FB *fbP,
 	/* set this 16z044s resolution to the one found in HW */
 	if ((res = men_16z044_GetResolution(fbP)) < 0)
 		return -EINVAL;
+	if (panel_256x64)
+		res = MEN_16Z044_RES_256X64;
+
+	/* gray levels of the 4bpp mode, raw nibbles shown as written */
+	for (i = 0; i < FB_16Z044_COLS; i++)
+		fbP->lut4[i] = i;
+	men_16z044_LatchLut(fbP, fbP->lut4);
+
+	/* 8bpp shows RGB 3:3:2 until a colormap is set */
+	for (i = 0; i < 256; i++) {
+		fbP->lut16_next[i] =
+			men_16z044_Rgb565((i >> 5) * 0xffff / 7,
+			                  ((i >> 2) & 7) * 0xffff / 7,
+			                  (i & 3) * 0xffff / 3);
+		fbP->lut16[i] = men_16z044_HwPixel(fbP, fbP->lut16_next[i]);
+	}
 
 	sprintf(fbP->name, "%s_%d", MEN_FB_NAME, instCount);
 
 	fbP->bits_per_pixel  = G_resol[res].bits_per_pixel;
+	if ((depth == 8 || depth == 32) && res < MEN_16Z044_RES_HW_NUM)
+		fbP->bits_per_pixel = depth;
+	else if (depth != 16)
+		printk(KERN_WARNING "%s: depth %u not supported, %dbpp\n",
+		       fbP->name, depth, fbP->bits_per_pixel);
 	fbP->bytes_per_pixel = fbP->bits_per_pixel >> 3;
-	fbP->xres            = G_resol[res].xres;
-	fbP->yres            = G_resol[res].yres;
-	fbP->line_length     = fbP->xres * fbP->bytes_per_pixel;
+	if (rotate > FB_ROTATE_CCW || (rotate &&
+	    (res >= MEN_16Z044_RES_HW_NUM ||
+	     fbP->bits_per_pixel != G_resol[res].bits_per_pixel)))
+		printk(KERN_WARNING "%s: rotate %u not supported\n",
+		       fbP->name, rotate);
+	else
+		fbP->rotate = fbP->rotate_req = rotate;
+	fbP->xres            = men_16z044_RotX(res, fbP->rotate);
+	fbP->yres            = men_16z044_RotY(res, fbP->rotate);
+	fbP->line_length     = fbP->xres * fbP->bits_per_pixel / 8;
+	fbP->res             = res;
+	fbP->hw_line_length  = men_16z044_HwBytes(fbP, G_resol[res].xres, 1);
+	fbP->modeswitch      = !!modeswitch;
+	if (coalesce && fbP->rotate)
+		printk(KERN_WARNING "%s: no coalescing with rotation\n",
+		       fbP->name);
+	else
+		fbP->coalesce = min_t(unsigned int, coalesce,
+		                      MEN_16Z044_MAX_COALESCE);
+	if (vt_screens > 1 && fbP->coalesce)
+		printk(KERN_WARNING "%s: no VT screens with coalescing\n",
+		       fbP->name);
+	else if (vt_screens > 1)
+		fbP->vt_screens = min3(vt_screens,
+		                       (unsigned int)MEN_16Z044_MAX_VT_SCREENS,
+		                       fbP->sdram_size / men_16z044_HwFrame(fbP));
+	if (fbP->vt_screens < 2)
+		fbP->vt_screens = 0;
+
+	/* packed pixels, palette modes, rotation, coalescing and VT screens
+	 * need the shadow */
+	if (fbP->bits_per_pixel != G_resol[res].bits_per_pixel ||
+	    fbP->bits_per_pixel < 8 || fbP->rotate || fbP->coalesce ||
+	    fbP->vt_screens) {
+		if (men_16z044_InitShadow(fbP))
+			return -ENOMEM;
+	} else if (shadow && men_16z044_InitShadow(fbP))
+		printk(KERN_WARNING "%s: no shadow buffer, drawing to SDRAM\n",
+		       fbP->name);
+	fbP->yres_virtual    = fbP->yres *
+		men_16z044_PanScreens(fbP, res, fbP->bits_per_pixel, fbP->rotate);
+	men_16z044_VramInit(fbP);
 
 	/* Initialize all needed Structs for the Framebuffer subsystem */
 	men_16z044_InitFixFb(fbP);
@@ -738,10 +4479,22 @@ static unsigned int men_16z044_InitDevData(struct MEN_16Z044_FB *fbP,
 	if (fbP->byteswap)
 		men_16z044_ByteSwap(fbP, 1);
 
-	if (fbP->refresh_rate == 75)
-		men_16z044_SetRefreshRate(fbP, 75);
-	else
-		men_16z044_SetRefreshRate(fbP, 60);
+	if (fbP->refresh_rate != 75)
+		fbP->refresh_rate = 60;
+	men_16z044_SetRefreshRate(fbP, fbP->refresh_rate);
+
+	fbP->refresh_policy = min_t(unsigned int, refresh_policy,
+	                            MEN_16Z044_GOV_NUM - 1);
+	fbP->refresh_burst  = MEN_16Z044_GOV_BURST_DEF;
+	fbP->refresh_idle   = MEN_16Z044_GOV_IDLE_DEF;
+	fbP->gov_stamp      = ktime_get();
+	if (fbP->refresh_policy != MEN_16Z044_GOV_FIXED)
+		schedule_delayed_work(&fbP->gov_work, 0);
+
+	fbP->idle_blank = min_t(unsigned int, idle_blank, 24 * 3600);
+	fbP->idle_stamp = jiffies;
+	if (fbP->idle_blank)
+		schedule_delayed_work(&fbP->idle_work, fbP->idle_blank * HZ);
 
 	/* new: Flatpanel Register, switch it on */
 	men_16z044_FlatPanel(fbP, 1);
@@ -769,9 +4522,43 @@ static struct MEN_16Z044_FB *men_16z044_AllocateDevice(void)
 
 	memset(newP, 0, sizeof(struct MEN_16Z044_FB));
 
+	/* statistics are optional, all counting is skipped without them */
+	newP->stats = alloc_percpu(struct MEN_16Z044_STATS);
+	mutex_init(&newP->flush_mutex);
+	mutex_init(&newP->vram_lock);
+	INIT_LIST_HEAD(&newP->surfs);
+	INIT_DELAYED_WORK(&newP->anim_work, men_16z044_AnimWork);
+	INIT_DELAYED_WORK(&newP->splash_work, men_16z044_SplashWork);
+	spin_lock_init(&newP->ctrl_lock);
+	INIT_DELAYED_WORK(&newP->gov_work, men_16z044_GovWork);
+	spin_lock_init(&newP->blank_lock);
+	INIT_DELAYED_WORK(&newP->idle_work, men_16z044_IdleWork);
+
 	return newP;
 }
 
+/**********************************************************************/
+/** unmap and free one 16Z044 device struct
+ *
+ * \brief  Counterpart of men_16z044_AllocateDevice and the mappings of
+ *         men_16z044_MapAdresses, the shadow and the surfaces must be
+ *         released before.
+ *
+ * \param \IN    fbP    pointer to struct of 16z044 data
+ */
+static void __maybe_unused men_16z044_FreeDevice(struct MEN_16Z044_FB *fbP)
+{
+#ifndef MEN_16Z044_MOCK
+	if (fbP->sdram_virt)
+		iounmap(fbP->sdram_virt);
+	if (fbP->dispctr_virt)
+		iounmap(fbP->dispctr_virt);
+#endif
+	free_percpu(fbP->stats);
+	vfree(fbP->cap);
+	kfree(fbP);
+}
+
 /***************************************************************************/
 /** setup and options processing function
  *
@@ -791,11 +4578,14 @@ int __init men_16z044_setup(char *options)
 			refresh = MEN_16Z044_REFRESH_75HZ;
 		else if (! strcmp(this_opt, "ref60"))
 			refresh = MEN_16Z044_REFRESH_60HZ;
+		else if (! strcmp(this_opt, "shadow"))
+			shadow = 1;
 	}
 
 	return 0;
 }
 
+#ifndef MEN_16Z044_KUNIT
 /*******************************************************************/
 /** PNP function for Framebuffer
  *
@@ -856,11 +4646,51 @@ static int __init fb16z044_probe(CHAMELEONV2_UNIT_T *fb_unit)
 	DPRINTK("barSdram=%d barDisp=%d offset disp= %04x\n",
 			ram_unit.unitFpga.bar, fb_unit->unitFpga.bar, fb_unit->unitFpga.offset);
 
-	if (men_16z044_InitDevData(drvDataP, 0))
+	if (men_16z044_InitDevData(drvDataP, 0)) {
+		men_16z044_ExitShadow(drvDataP);
+		men_16z044_FreeDevice(drvDataP);
 		return -ENOMEM;
+	}
+
+	men_16z044_Calibrate(drvDataP);
 
-	if (register_framebuffer(&drvDataP->info) < 0)
+	if (drvDataP->shadow) {
+		drvDataP->info.fbdefio = &drvDataP->defio;
+		fb_deferred_io_init(&drvDataP->info);
+	}
+
+	/* FBIOGETCMAP of the palette modes */
+	if (fb_alloc_cmap(&drvDataP->info.cmap, 256, 0))
+		printk(KERN_WARNING "%s: no colormap\n", drvDataP->name);
+
+	/* after the calibration, which writes behind the screen */
+	men_16z044_SplashInit(drvDataP);
+
+	if (register_framebuffer(&drvDataP->info) < 0) {
+		cancel_delayed_work_sync(&drvDataP->splash_work);
+		men_16z044_SplashHide(drvDataP);
+		fb_dealloc_cmap(&drvDataP->info.cmap);
+		if (drvDataP->shadow)
+			fb_deferred_io_cleanup(&drvDataP->info);
+		/* armed by men_16z044_InitDevData */
+		drvDataP->idle_blank = 0;
+		cancel_delayed_work_sync(&drvDataP->idle_work);
+		cancel_delayed_work_sync(&drvDataP->gov_work);
+		men_16z044_ExitShadow(drvDataP);
+		men_16z044_VramExit(drvDataP);
+		men_16z044_FreeDevice(drvDataP);
 		return -EINVAL;
+	}
+
+	men_16z044_DebugfsInit(drvDataP);
+	men_16z044_SysfsAttrs(drvDataP, G_devAttrs, 1);
+
+	if (drvDataP->shadow) {
+		men_16z044_SysfsAttrs(drvDataP, G_shadowAttrs, 1);
+		/* bring SDRAM in sync with the cleared shadow */
+		men_16z044_Damage(drvDataP, 0, 0, drvDataP->xres,
+		                  drvDataP->yres_virtual);
+	}
 
 	fb_unit->driver_data = drvDataP; /* fb_unit = DISP unit here for later remove() */
 
@@ -885,11 +4715,25 @@ static int fb16z044_remove(CHAMELEONV2_UNIT_T *chu )
 	}
 
 	if (info) {
+		if (fbP->shadow)
+			men_16z044_SysfsAttrs(fbP, G_shadowAttrs, 0);
+		men_16z044_SysfsAttrs(fbP, G_devAttrs, 0);
+		cancel_delayed_work_sync(&fbP->gov_work);
+		fbP->idle_blank = 0;
+		cancel_delayed_work_sync(&fbP->idle_work);
+		debugfs_remove_recursive(fbP->debugfs);
+		fbP->cap_on = 0;
 		unregister_framebuffer(info);
+		fb_dealloc_cmap(&info->cmap);
+		if (fbP->shadow)
+			fb_deferred_io_cleanup(info);
+		men_16z044_AnimStop(fbP);
+		cancel_delayed_work_sync(&fbP->splash_work);
+		men_16z044_SplashHide(fbP);
+		men_16z044_ExitShadow(fbP);
+		men_16z044_VramExit(fbP);
 		framebuffer_release(info);
-		iounmap(fbP->sdram_virt );
-		iounmap(fbP->dispctr_virt);
-		kfree(fbP);
+		men_16z044_FreeDevice(fbP);
 	} else {
 		printk(KERN_ERR "*** error: internal driver data corrupt!\n");
 		return -EBUSY;
@@ -934,6 +4778,7 @@ static void __exit men_16z044_cleanup(void)
 	/* this calls .remove() automatically */
 	men_chameleonV2_unregister_driver(&G_driver );
 }
+#endif /* MEN_16Z044_KUNIT */
 
 /* let fb driver be configured with kernel parameters */
 __setup("fb16z044_mode=", men_16z044_setup);
@@ -947,5 +4792,40 @@ module_param(refresh, uint, 0 );
 
 MODULE_PARM_DESC(refresh, "refresh rate in Hz: refresh=[60 or 75] ");
 
+module_param(shadow, uint, 0);
+MODULE_PARM_DESC(shadow, "draw into a RAM shadow, flush damage to SDRAM: shadow=[0 or 1] ");
+module_param(flush_band, uint, 0);
+MODULE_PARM_DESC(flush_band, "lines per band of a parallel flush (0: one band) ");
+module_param(flush_workers, uint, 0);
+MODULE_PARM_DESC(flush_workers, "max. CPUs flushing one damage rect (1..8) ");
+module_param(flush_mt_min, uint, 0);
+MODULE_PARM_DESC(flush_mt_min, "min. damage in bytes flushed in parallel ");
+module_param(capture, uint, 0);
+MODULE_PARM_DESC(capture, "records in the debugfs access capture ring (0: off, max. 1048576) ");
+module_param(calibrate, uint, 0);
+MODULE_PARM_DESC(calibrate, "select the fastest SDRAM copy/fill at probe: calibrate=[0 or 1] ");
+module_param(depth, uint, 0);
+MODULE_PARM_DESC(depth, "bits per pixel: 16 (RGB565), 8 (pseudocolour) or 32 (XRGB8888), 8 and 32 are converted at flush and use the shadow ");
+module_param(rotate, uint, 0);
+MODULE_PARM_DESC(rotate, "rotate the screen in the shadow flush: 0, 1 (90 cw), 2 (180), 3 (90 ccw) ");
+module_param(coalesce, uint, 0);
+MODULE_PARM_DESC(coalesce, "screens fbcon scrolls over by panning, flushed once per frame (0: off, max. 4) ");
+module_param(vt_screens, uint, 0);
+MODULE_PARM_DESC(vt_screens, "first VTs with an own SDRAM screen, switched by frame offset (0: off, max. 8) ");
+module_param(splash, charp, 0);
+MODULE_PARM_DESC(splash, "firmware file with one raw screen in the SDRAM format, shown until the first client opens the device ");
+module_param(splash_ms, uint, 0);
+MODULE_PARM_DESC(splash_ms, "hide the splash after <ms> at the latest (0: never) ");
+module_param(panel_256x64, uint, 0);
+MODULE_PARM_DESC(panel_256x64, "256x64 panel at 4bpp gray levels: panel_256x64=[0 or 1] ");
+module_param(modeswitch, uint, 0);
+MODULE_PARM_DESC(modeswitch, "FPGA supports resolution changes by fb_set_par: modeswitch=[0 or 1] ");
+module_param(idle_blank, uint, 0);
+MODULE_PARM_DESC(idle_blank, "blank display and panel after <s> without drawing (0: off) ");
+module_param(refresh_policy, uint, 0);
+MODULE_PARM_DESC(refresh_policy, "refresh governor: 0 fixed, 1 auto (60 Hz during upload bursts), 2 powersave ");
+
+#ifndef MEN_16Z044_KUNIT
 module_init(men_16z044_init);
 module_exit(men_16z044_cleanup);
+#endif
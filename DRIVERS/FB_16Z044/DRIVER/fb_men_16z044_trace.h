@@ -0,0 +1,211 @@
+/*********************  P r o g r a m  -  M o d u l e ***********************/
+/*!
+ *        \file  fb_men_16z044_trace.h
+ *
+ *     \brief  Static tracepoints of the 16z044 framebuffer driver.
+ *             Events are in /sys/kernel/tracing/events/fb16z044 and cost
+ *             nothing while disabled, e.g.
+ *               trace-cmd record -e fb16z044
+ *               perf stat -e 'fb16z044:*'
+ *
+ *     Switches: CREATE_TRACE_POINTS (defined once in fb_men_16z044.c)
+ */
+/*
+ *---------------------------------------------------------------------------
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+/*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM fb16z044
+
+#if !defined(_FB_MEN_16Z044_TRACE_H_) || defined(TRACE_HEADER_MULTI_READ)
+#define _FB_MEN_16Z044_TRACE_H_
+
+#include <linux/version.h>
+#include <linux/tracepoint.h>
+#include <MEN/fb_men_16z044.h>
+
+/* every event carries the fb name (fb16z044_<n>) */
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,10,0)
+#define fb16z044_assign_name()  __assign_str(name)
+#else
+#define fb16z044_assign_name()  __assign_str(name, name)
+#endif
+
+#define show_fb16z044_ioctl(cmd) __print_symbolic(cmd,                     \
+	{ FBIO_ENABLE_MEN_16Z044_TEST,  "FBIO_ENABLE_MEN_16Z044_TEST"  },   \
+	{ FBIO_DISABLE_MEN_16Z044_TEST, "FBIO_DISABLE_MEN_16Z044_TEST" },   \
+	{ FBIO_ENABLE_75HZ,             "FBIO_ENABLE_75HZ"             },   \
+	{ FBIO_ENABLE_60HZ,             "FBIO_ENABLE_60HZ"             },   \
+	{ FBIO_MEN_16Z044_RES_640X480,  "FBIO_MEN_16Z044_RES_640X480"  },   \
+	{ FBIO_MEN_16Z044_RES_800X600,  "FBIO_MEN_16Z044_RES_800X600"  },   \
+	{ FBIO_MEN_16Z044_RES_1024X768, "FBIO_MEN_16Z044_RES_1024X768" },   \
+	{ FBIO_MEN_16Z044_RES_1280X1024, "FBIO_MEN_16Z044_RES_1280X1024" }, \
+	{ FBIO_MEN_16Z044_BLANK,        "FBIO_MEN_16Z044_BLANK"        },   \
+	{ FBIO_MEN_16Z044_UNBLANK,      "FBIO_MEN_16Z044_UNBLANK"      },   \
+	{ FBIO_MEN_16Z044_SWAP_ON,      "FBIO_MEN_16Z044_SWAP_ON"      },   \
+	{ FBIO_MEN_16Z044_SWAP_OFF,     "FBIO_MEN_16Z044_SWAP_OFF"     },   \
+	{ FBIO_MEN_16Z044_SET_SCREEN,   "FBIO_MEN_16Z044_SET_SCREEN"   },   \
+	{ FBIO_MEN_16Z044_SURF_ALLOC,   "FBIO_MEN_16Z044_SURF_ALLOC"   },   \
+	{ FBIO_MEN_16Z044_SURF_FREE,    "FBIO_MEN_16Z044_SURF_FREE"    },   \
+	{ FBIO_MEN_16Z044_SURF_UPLOAD,  "FBIO_MEN_16Z044_SURF_UPLOAD"  },   \
+	{ FBIO_MEN_16Z044_SURF_BLIT,    "FBIO_MEN_16Z044_SURF_BLIT"    },   \
+	{ FBIO_MEN_16Z044_ANIM_START,   "FBIO_MEN_16Z044_ANIM_START"   },   \
+	{ FBIO_MEN_16Z044_ANIM_STOP,    "FBIO_MEN_16Z044_ANIM_STOP"    })
+
+/* ioctl entry / exit */
+TRACE_EVENT(fb16z044_ioctl_enter,
+	TP_PROTO(const char *name, unsigned int cmd, unsigned long arg),
+	TP_ARGS(name, cmd, arg),
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(unsigned int, cmd)
+		__field(unsigned long, arg)
+	),
+	TP_fast_assign(
+		fb16z044_assign_name();
+		__entry->cmd = cmd;
+		__entry->arg = arg;
+	),
+	TP_printk("%s cmd=%s (0x%08x) arg=0x%lx", __get_str(name),
+	          show_fb16z044_ioctl(__entry->cmd), __entry->cmd, __entry->arg)
+);
+
+TRACE_EVENT(fb16z044_ioctl_exit,
+	TP_PROTO(const char *name, unsigned int cmd, int ret),
+	TP_ARGS(name, cmd, ret),
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(unsigned int, cmd)
+		__field(int, ret)
+	),
+	TP_fast_assign(
+		fb16z044_assign_name();
+		__entry->cmd = cmd;
+		__entry->ret = ret;
+	),
+	TP_printk("%s cmd=%s ret=%d", __get_str(name),
+	          show_fb16z044_ioctl(__entry->cmd), __entry->ret)
+);
+
+/* commit of a display controller register (ctrl, flat panel) */
+TRACE_EVENT(fb16z044_reg_write,
+	TP_PROTO(const char *name, u32 reg, u32 val),
+	TP_ARGS(name, reg, val),
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(u32, reg)
+		__field(u32, val)
+	),
+	TP_fast_assign(
+		fb16z044_assign_name();
+		__entry->reg = reg;
+		__entry->val = val;
+	),
+	TP_printk("%s reg=0x%02x val=0x%08x", __get_str(name),
+	          __entry->reg, __entry->val)
+);
+
+/* byte offset of the displayed screen in SDRAM */
+TRACE_EVENT(fb16z044_frame_offset,
+	TP_PROTO(const char *name, u32 offs),
+	TP_ARGS(name, offs),
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(u32, offs)
+	),
+	TP_fast_assign(
+		fb16z044_assign_name();
+		__entry->offs = offs;
+	),
+	TP_printk("%s offs=0x%08x", __get_str(name), __entry->offs)
+);
+
+/* drawing operations, bytes written to the frame buffer memory */
+DECLARE_EVENT_CLASS(fb16z044_rect,
+	TP_PROTO(const char *name, u32 x, u32 y, u32 w, u32 h, u32 bytes),
+	TP_ARGS(name, x, y, w, h, bytes),
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(u32, x)
+		__field(u32, y)
+		__field(u32, w)
+		__field(u32, h)
+		__field(u32, bytes)
+	),
+	TP_fast_assign(
+		fb16z044_assign_name();
+		__entry->x     = x;
+		__entry->y     = y;
+		__entry->w     = w;
+		__entry->h     = h;
+		__entry->bytes = bytes;
+	),
+	TP_printk("%s %ux%u+%u+%u bytes=%u", __get_str(name), __entry->w,
+	          __entry->h, __entry->x, __entry->y, __entry->bytes)
+);
+
+DEFINE_EVENT(fb16z044_rect, fb16z044_fillrect,
+	TP_PROTO(const char *name, u32 x, u32 y, u32 w, u32 h, u32 bytes),
+	TP_ARGS(name, x, y, w, h, bytes));
+
+DEFINE_EVENT(fb16z044_rect, fb16z044_copyarea,
+	TP_PROTO(const char *name, u32 x, u32 y, u32 w, u32 h, u32 bytes),
+	TP_ARGS(name, x, y, w, h, bytes));
+
+DEFINE_EVENT(fb16z044_rect, fb16z044_imageblit,
+	TP_PROTO(const char *name, u32 x, u32 y, u32 w, u32 h, u32 bytes),
+	TP_ARGS(name, x, y, w, h, bytes));
+
+/* shadow buffer flushed to SDRAM */
+TRACE_EVENT(fb16z044_flush,
+	TP_PROTO(const char *name, u32 x1, u32 y1, u32 x2, u32 y2, u32 bytes,
+	         int parallel, u64 ns),
+	TP_ARGS(name, x1, y1, x2, y2, bytes, parallel, ns),
+	TP_STRUCT__entry(
+		__string(name, name)
+		__field(u32, x1)
+		__field(u32, y1)
+		__field(u32, x2)
+		__field(u32, y2)
+		__field(u32, bytes)
+		__field(int, parallel)
+		__field(u64, ns)
+	),
+	TP_fast_assign(
+		fb16z044_assign_name();
+		__entry->x1       = x1;
+		__entry->y1       = y1;
+		__entry->x2       = x2;
+		__entry->y2       = y2;
+		__entry->bytes    = bytes;
+		__entry->parallel = parallel;
+		__entry->ns       = ns;
+	),
+	TP_printk("%s (%u,%u)-(%u,%u) bytes=%u %s ns=%llu", __get_str(name),
+	          __entry->x1, __entry->y1, __entry->x2, __entry->y2,
+	          __entry->bytes, __entry->parallel ? "parallel" : "single",
+	          (unsigned long long)__entry->ns)
+);
+
+#endif /* _FB_MEN_16Z044_TRACE_H_ */
+
+/* this part must be outside the header guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE fb_men_16z044_trace
+#include <trace/define_trace.h>
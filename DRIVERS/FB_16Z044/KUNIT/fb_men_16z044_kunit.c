@@ -0,0 +1,633 @@
+/*********************  P r o g r a m  -  M o d u l e ***********************/
+/*!
+ *        \file  fb_men_16z044_kunit.c
+ *
+ *     \brief  KUnit benchmarks of the 16z044 framebuffer driver.
+ *             The driver is built into this file, its SDRAM and register
+ *             BARs are vmalloc'ed RAM handed out by men_16z044_mock_bar().
+ *             The benchmarks run at the four HW resolutions of G_resol,
+ *             the 4bpp panel is checked against a per-pixel reference.
+ *             The device is set up by men_16z044_InitDevData() just like
+ *             on probe. Results are printed as ns/op and MB/s, e.g.
+ *               ./tools/testing/kunit/kunit.py run --arch=x86_64 \
+ *                   --kunitconfig=drivers/video/fbdev/men16z044/KUNIT
+ *
+ *     Switches: -
+ */
+/*
+ *---------------------------------------------------------------------------
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+/*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#define MEN_16Z044_MOCK
+#define MEN_16Z044_KUNIT
+#include "../DRIVER/fb_men_16z044.c"
+
+#include <kunit/test.h>
+
+/*-----------------------------+
+ |  DEFINES                    |
+ +-----------------------------*/
+#define KUNIT_BAR_DISP          0
+#define KUNIT_BAR_SDRAM         1
+#define KUNIT_SDRAM_SIZE        (8*1024*1024)   /* like a Z043 with 8MB */
+#define KUNIT_LOOPS             32              /* full screen ops      */
+#define KUNIT_GLYPH_W           8               /* fbcon font size      */
+#define KUNIT_GLYPH_H           16
+#define KUNIT_FG                15              /* white                */
+#define KUNIT_BG                0               /* black                */
+
+
+/*--------------------------------+
+ |  TYPEDEFS                      |
+ +--------------------------------*/
+/* RAM BARs of the device under test */
+struct KUNIT_DEV
+{
+	void *regs;
+	void *sdram;
+	struct pci_dev pdev;
+	struct MEN_16Z044_FB *fbP;
+	unsigned int shadow;              /* module parameters to restore */
+	unsigned int panel;
+	unsigned int rotate;
+};
+
+
+/*--------------------------------+
+ |  GLOBALS                       |
+ +--------------------------------*/
+/* cases of a suite run one after the other, one device at a time */
+static struct KUNIT_DEV *G_kdev;
+
+/* fbcon style glyph, a framed box */
+static const u8 G_glyph[KUNIT_GLYPH_H] = {
+	0x00, 0x00, 0x7e, 0x42, 0x42, 0x42, 0x42, 0x42,
+	0x42, 0x42, 0x42, 0x42, 0x42, 0x7e, 0x00, 0x00
+};
+
+/* resolutions of the benchmarks, the modes of RES_MASK */
+static const unsigned int G_kunitRes[MEN_16Z044_RES_HW_NUM] = { 0, 1, 2, 3 };
+
+/* rotations of the rotated flush */
+static const unsigned int G_kunitRot[] = {
+	FB_ROTATE_CW, FB_ROTATE_UD, FB_ROTATE_CCW
+};
+
+
+/**********************************************************************/
+/** BARs of the KUnit device, replaces fb_men_16z044_mock.ko
+ *
+ * \returns virtual address of the BAR or NULL
+ */
+void *men_16z044_mock_bar(struct pci_dev *pdev, int bar, u32 *physP, u32 *sizeP)
+{
+	if (!G_kdev || pdev != &G_kdev->pdev)
+		return NULL;
+
+	switch (bar) {
+	case KUNIT_BAR_DISP:
+		*physP = virt_to_phys(G_kdev->regs);
+		*sizeP = PAGE_SIZE;
+		return G_kdev->regs;
+	case KUNIT_BAR_SDRAM:
+		*physP = 0;
+		*sizeP = KUNIT_SDRAM_SIZE;
+		return G_kdev->sdram;
+	default:
+		return NULL;
+	}
+}
+
+/**********************************************************************/
+/** print the result of a benchmark
+ *
+ * \param \IN   test   running test
+ * \param \IN   op     name of the operation
+ * \param \IN   n      number of operations done
+ * \param \IN   bytes  bytes written by all operations, 0 if not applicable
+ * \param \IN   ns     duration of all operations
+ */
+static void men_16z044_KunitReport(struct kunit *test, const char *op,
+                                   unsigned int n, u64 bytes, s64 ns)
+{
+	if (ns <= 0)
+		ns = 1;
+
+	if (bytes)
+		kunit_info(test, "%-16s %7u ops %10lld ns/op %8llu MB/s\n", op,
+		           n, div_s64(ns, n), div64_u64(bytes * 1000, ns));
+	else
+		kunit_info(test, "%-16s %7u ops %10lld ns/op\n", op, n,
+		           div_s64(ns, n));
+}
+
+/**********************************************************************/
+/** set up a 16z044 at a resolution
+ *
+ * \brief  The resolution bits of the display control register are
+ *         preset, men_16z044_InitDevData() then reads them back and
+ *         initialises everything the way probe does. The 4bpp panel
+ *         is selected by its module parameter on top of mode 0, the
+ *         rotation is the one of the rotate module parameter.
+ *
+ * \param \IN   test      running test
+ * \param \IN   res       index into G_resol
+ * \param \IN   shadowed  1 to draw into a shadow buffer
+ *
+ * \returns the device, the test is aborted on errors
+ */
+static struct MEN_16Z044_FB *men_16z044_KunitDevRes(struct kunit *test,
+                                                    unsigned int res,
+                                                    unsigned int shadowed)
+{
+	struct KUNIT_DEV *kd = test->priv;
+	struct MEN_16Z044_FB *fbP;
+
+	kd->regs  = (void *)get_zeroed_page(GFP_KERNEL);
+	kd->sdram = vzalloc(KUNIT_SDRAM_SIZE);
+	KUNIT_ASSERT_NOT_NULL(test, kd->regs);
+	KUNIT_ASSERT_NOT_NULL(test, kd->sdram);
+	*(u32 *)(kd->regs + Z044_DISP_CTRL) =
+		res < MEN_16Z044_RES_HW_NUM ? res : 0;
+
+	kd->fbP = fbP = men_16z044_AllocateDevice();
+	KUNIT_ASSERT_NOT_NULL(test, fbP);
+	fbP->pdev     = &kd->pdev;
+	fbP->barSdram = KUNIT_BAR_SDRAM;
+	fbP->barDisp  = KUNIT_BAR_DISP;
+
+	G_kdev = kd;
+	shadow       = shadowed;
+	panel_256x64 = res == MEN_16Z044_RES_256X64;
+	KUNIT_ASSERT_EQ(test, men_16z044_InitDevData(fbP, 0), 0U);
+	KUNIT_ASSERT_EQ(test, fbP->res, res);
+	KUNIT_ASSERT_EQ(test, fbP->rotate, rotate);
+	KUNIT_ASSERT_EQ(test, fbP->xres, men_16z044_RotX(res, rotate));
+	KUNIT_ASSERT_EQ(test, fbP->yres, men_16z044_RotY(res, rotate));
+	KUNIT_ASSERT_EQ(test, !!fbP->shadow, !!shadowed);
+
+	return fbP;
+}
+
+/* set up a 16z044 at the resolution of the current parameter */
+static struct MEN_16Z044_FB *men_16z044_KunitDev(struct kunit *test,
+                                                 unsigned int shadowed)
+{
+	return men_16z044_KunitDevRes(test,
+	                              *(const unsigned int *)test->param_value,
+	                              shadowed);
+}
+
+static int men_16z044_KunitInit(struct kunit *test)
+{
+	struct KUNIT_DEV *kd;
+
+	test->priv = kd = kunit_kzalloc(test, sizeof(*kd), GFP_KERNEL);
+	if (!kd)
+		return -ENOMEM;
+
+	kd->shadow = shadow;
+	kd->panel  = panel_256x64;
+	kd->rotate = rotate;
+	return 0;
+}
+
+static void men_16z044_KunitExit(struct kunit *test)
+{
+	struct KUNIT_DEV *kd = test->priv;
+
+	shadow       = kd->shadow;
+	panel_256x64 = kd->panel;
+	rotate       = kd->rotate;
+	if (kd->fbP) {
+		cancel_delayed_work_sync(&kd->fbP->gov_work);
+		cancel_delayed_work_sync(&kd->fbP->idle_work);
+		men_16z044_ExitShadow(kd->fbP);
+		free_percpu(kd->fbP->stats);
+		kfree(kd->fbP);
+	}
+	G_kdev = NULL;
+	vfree(kd->sdram);
+	free_page((unsigned long)kd->regs);
+}
+
+/**********************************************************************/
+/** read a pixel of the drawing target (SDRAM or shadow)
+ */
+static u16 men_16z044_KunitPixel(struct MEN_16Z044_FB *fbP, u32 x, u32 y)
+{
+	return *(u16 *)((u8 *)fbP->info.screen_base + y * fbP->line_length +
+	                x * fbP->bytes_per_pixel);
+}
+
+/**********************************************************************/
+/** setcolreg, load the 16 console colours
+ */
+static void men_16z044_TestSetcolreg(struct kunit *test)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_KunitDev(test, 0);
+	unsigned int i, n = KUNIT_LOOPS * 1024;
+	ktime_t t0;
+
+	t0 = ktime_get();
+	for (i = 0; i < n; i++)
+		men_16z044_setcolreg(i % FB_16Z044_COLS, i << 4, ~i << 4, i << 8,
+		                     0, &fbP->info);
+	men_16z044_KunitReport(test, "setcolreg", n, 0,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+
+	men_16z044_setcolreg(KUNIT_FG, 0xffff, 0xffff, 0xffff, 0, &fbP->info);
+	KUNIT_EXPECT_EQ(test, ((u32 *)fbP->info.pseudo_palette)[KUNIT_FG],
+	                (u32)0xffff);
+	KUNIT_EXPECT_NE(test, men_16z044_setcolreg(FB_16Z044_COLS, 0, 0, 0, 0,
+	                                           &fbP->info), 0);
+}
+
+/**********************************************************************/
+/** fillrect, copyarea and imageblit the way fbcon uses them
+ *
+ * \param \IN   test      running test
+ * \param \IN   shadowed  draw into the shadow buffer instead of SDRAM
+ */
+static void men_16z044_KunitDraw(struct kunit *test, unsigned int shadowed)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_KunitDev(test, shadowed);
+	struct fb_info *info = &fbP->info;
+	struct fb_fillrect rect;
+	struct fb_copyarea area;
+	struct fb_image image;
+	u32 screen = fbP->line_length * fbP->yres;
+	u32 cols = fbP->xres / KUNIT_GLYPH_W;
+	u32 lines = fbP->yres / KUNIT_GLYPH_H;
+	unsigned int i, n;
+	ktime_t t0;
+
+	men_16z044_setcolreg(KUNIT_FG, 0xffff, 0xffff, 0xffff, 0, info);
+	men_16z044_setcolreg(KUNIT_BG, 0, 0, 0, 0, info);
+
+	/* clear screen */
+	rect.dx     = 0;
+	rect.dy     = 0;
+	rect.width  = fbP->xres;
+	rect.height = fbP->yres;
+	rect.color  = KUNIT_FG;
+	rect.rop    = ROP_COPY;
+	t0 = ktime_get();
+	for (i = 0; i < KUNIT_LOOPS; i++)
+		men_16z044_fillrect(info, &rect);
+	men_16z044_KunitReport(test, "fillrect screen", KUNIT_LOOPS,
+	                       (u64)KUNIT_LOOPS * screen,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+	KUNIT_EXPECT_EQ(test, men_16z044_KunitPixel(fbP, fbP->xres - 1,
+	                                            fbP->yres - 1), (u16)0xffff);
+
+	/* cursor sized fills over the whole screen */
+	rect.width  = KUNIT_GLYPH_W;
+	rect.height = KUNIT_GLYPH_H;
+	rect.color  = KUNIT_BG;
+	n = cols * lines;
+	t0 = ktime_get();
+	for (i = 0; i < n; i++) {
+		rect.dx = (i % cols) * KUNIT_GLYPH_W;
+		rect.dy = (i / cols) * KUNIT_GLYPH_H;
+		men_16z044_fillrect(info, &rect);
+	}
+	men_16z044_KunitReport(test, "fillrect glyph", n,
+	                       (u64)n * KUNIT_GLYPH_W * KUNIT_GLYPH_H *
+	                       fbP->bytes_per_pixel,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+	KUNIT_EXPECT_EQ(test, men_16z044_KunitPixel(fbP, 0, 0), (u16)0);
+
+	/* glyphs of a full screen of text */
+	memset(&image, 0, sizeof(image));
+	image.width    = KUNIT_GLYPH_W;
+	image.height   = KUNIT_GLYPH_H;
+	image.fg_color = KUNIT_FG;
+	image.bg_color = KUNIT_BG;
+	image.depth    = 1;
+	image.data     = G_glyph;
+	t0 = ktime_get();
+	for (i = 0; i < n; i++) {
+		image.dx = (i % cols) * KUNIT_GLYPH_W;
+		image.dy = (i / cols) * KUNIT_GLYPH_H;
+		men_16z044_imageblit(info, &image);
+	}
+	men_16z044_KunitReport(test, "imageblit glyph", n,
+	                       (u64)n * KUNIT_GLYPH_W * KUNIT_GLYPH_H *
+	                       fbP->bytes_per_pixel,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+	KUNIT_EXPECT_EQ(test, men_16z044_KunitPixel(fbP, 1, 2), (u16)0xffff);
+	KUNIT_EXPECT_EQ(test, men_16z044_KunitPixel(fbP, 0, 2), (u16)0);
+
+	/* scroll up by one text line, clear the first glyph of line 1 before */
+	rect.dx = 0;
+	rect.dy = KUNIT_GLYPH_H;
+	men_16z044_fillrect(info, &rect);
+	area.sx     = 0;
+	area.sy     = KUNIT_GLYPH_H;
+	area.dx     = 0;
+	area.dy     = 0;
+	area.width  = fbP->xres;
+	area.height = fbP->yres - KUNIT_GLYPH_H;
+	men_16z044_copyarea(info, &area);
+	KUNIT_EXPECT_EQ(test, men_16z044_KunitPixel(fbP, 1, 2), (u16)0);
+	KUNIT_EXPECT_EQ(test, men_16z044_KunitPixel(fbP, KUNIT_GLYPH_W + 1, 2),
+	                (u16)0xffff);
+
+	t0 = ktime_get();
+	for (i = 0; i < KUNIT_LOOPS; i++)
+		men_16z044_copyarea(info, &area);
+	men_16z044_KunitReport(test, "copyarea scroll", KUNIT_LOOPS,
+	                       (u64)KUNIT_LOOPS * area.width * area.height *
+	                       fbP->bytes_per_pixel,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+}
+
+static void men_16z044_TestDrawDirect(struct kunit *test)
+{
+	men_16z044_KunitDraw(test, 0);
+}
+
+static void men_16z044_TestDrawShadow(struct kunit *test)
+{
+	men_16z044_KunitDraw(test, 1);
+}
+
+/**********************************************************************/
+/** flush of the shadow buffer, single CPU and banded parallel
+ */
+static void men_16z044_TestFlush(struct kunit *test)
+{
+	struct MEN_16Z044_FB *fbP = men_16z044_KunitDev(test, 1);
+	u32 screen = fbP->line_length * fbP->yres;
+	u32 glyph = KUNIT_GLYPH_W * KUNIT_GLYPH_H * fbP->bytes_per_pixel;
+	unsigned int i, n;
+	ktime_t t0;
+
+	/* glyph sized damage, always flushed by the caller */
+	n = KUNIT_LOOPS * 64;
+	t0 = ktime_get();
+	for (i = 0; i < n; i++) {
+		men_16z044_Damage(fbP, (i * KUNIT_GLYPH_W) % fbP->xres, 0,
+		                  KUNIT_GLYPH_W, KUNIT_GLYPH_H);
+		men_16z044_Flush(fbP);
+	}
+	men_16z044_KunitReport(test, "flush glyph", n, (u64)n * glyph,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+
+	/* full screen by one CPU */
+	memset(fbP->shadow, 0x5a, screen);
+	fbP->flush_mt_min = U32_MAX;
+	t0 = ktime_get();
+	for (i = 0; i < KUNIT_LOOPS; i++) {
+		men_16z044_Damage(fbP, 0, 0, fbP->xres, fbP->yres);
+		men_16z044_Flush(fbP);
+	}
+	men_16z044_KunitReport(test, "flush single", KUNIT_LOOPS,
+	                       (u64)KUNIT_LOOPS * screen,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+	KUNIT_EXPECT_EQ(test, memcmp(fbP->sdram_virt, fbP->shadow, screen), 0);
+	KUNIT_EXPECT_EQ(test, fbP->flush_count[MEN_16Z044_FLUSH_PARALLEL], 0UL);
+
+	/* full screen in bands by the flush pool */
+	if (!fbP->flush_wq || num_online_cpus() < 2) {
+		kunit_info(test, "flush parallel   skipped, single CPU\n");
+		return;
+	}
+	memset(fbP->shadow, 0xa5, screen);
+	fbP->flush_mt_min = 0;
+	t0 = ktime_get();
+	for (i = 0; i < KUNIT_LOOPS; i++) {
+		men_16z044_Damage(fbP, 0, 0, fbP->xres, fbP->yres);
+		men_16z044_Flush(fbP);
+	}
+	men_16z044_KunitReport(test, "flush parallel", KUNIT_LOOPS,
+	                       (u64)KUNIT_LOOPS * screen,
+	                       ktime_to_ns(ktime_sub(ktime_get(), t0)));
+	KUNIT_EXPECT_EQ(test, memcmp(fbP->sdram_virt, fbP->shadow, screen), 0);
+	KUNIT_EXPECT_GT(test, fbP->flush_count[MEN_16Z044_FLUSH_PARALLEL], 0UL);
+}
+
+/**********************************************************************/
+/** compare the 4bpp shadow with the reference, one byte per pixel
+ *
+ * \returns number of pixels that differ
+ */
+static unsigned int men_16z044_KunitDiff4(struct MEN_16Z044_FB *fbP,
+                                          const u8 *ref)
+{
+	unsigned int x, y, n = 0;
+
+	for (y = 0; y < fbP->yres; y++)
+		for (x = 0; x < fbP->xres; x++)
+			if (men_16z044_Get4(men_16z044_Pix4(fbP, x, y), x) !=
+			    ref[y * fbP->xres + x])
+				n++;
+	return n;
+}
+
+/**********************************************************************/
+/** 4bpp panel, fills, copies and glyphs at odd and even x against a
+ *  reference drawn pixel by pixel
+ */
+static void men_16z044_TestPanel(struct kunit *test)
+{
+	/* odd and even x and widths, whole bytes and nibbles at the edges */
+	static const u32 xs[] = { 6, 7 };
+	static const u32 ws[] = { 1, 2, 3, 8, 9, 16, 17 };
+	/* dx, dy, width, height, sx, sy */
+	static const struct fb_copyarea copies[] = {
+		{ 20, 20,  9, 4,  6,  8 },   /* same alignment, other rows */
+		{ 21, 20,  8, 4,  7,  8 },
+		{ 21, 20,  9, 4,  6,  8 },   /* nibbles shifted */
+		{ 20, 20,  8, 4,  7,  8 },
+		{ 13, 30, 20, 4, 10, 30 },   /* same rows, to the right */
+		{ 12, 30, 21, 4, 10, 30 },
+		{ 10, 30, 20, 4, 13, 30 },   /* same rows, to the left */
+		{ 10, 30, 21, 4, 12, 30 },
+		{  5, 42, 17, 6,  5, 40 },   /* overlap downwards */
+		{  8, 41, 17, 6,  5, 40 },
+		{  5, 40, 17, 6,  5, 42 },   /* overlap upwards */
+		{  5, 40, 17, 6,  8, 41 },
+	};
+	struct MEN_16Z044_FB *fbP =
+		men_16z044_KunitDevRes(test, MEN_16Z044_RES_256X64, 1);
+	struct fb_info *info = &fbP->info;
+	const struct fb_copyarea *a;
+	struct fb_fillrect rect;
+	struct fb_image image;
+	u32 w = fbP->xres, x, y, i, j, k;
+	u8 *ref, *tmp;
+
+	KUNIT_ASSERT_EQ(test, fbP->bits_per_pixel, 4U);
+	ref = kunit_kzalloc(test, w * fbP->yres, GFP_KERNEL);
+	tmp = kunit_kzalloc(test, w * fbP->yres, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_NULL(test, ref);
+	KUNIT_ASSERT_NOT_NULL(test, tmp);
+
+	/* a pattern that tells neighbouring pixels apart */
+	for (y = 0; y < fbP->yres; y++)
+		for (x = 0; x < w; x++) {
+			ref[y * w + x] = (x * 5 + y * 3) & 0xf;
+			men_16z044_Put4(men_16z044_Pix4(fbP, x, y), x,
+			                ref[y * w + x]);
+		}
+
+	/* fills and xors, each width in rows of its own */
+	rect.height = 3;
+	rect.color  = 9;
+	for (k = 0; k < 2 * ARRAY_SIZE(xs) * ARRAY_SIZE(ws); k++) {
+		rect.rop   = k & 1 ? ROP_XOR : ROP_COPY;
+		rect.dx    = xs[(k >> 1) % ARRAY_SIZE(xs)];
+		rect.width = ws[(k >> 1) / ARRAY_SIZE(xs)];
+		rect.dy    = 2 + (k >> 1) / ARRAY_SIZE(xs) * rect.height;
+		men_16z044_fillrect(info, &rect);
+		for (y = rect.dy; y < rect.dy + rect.height; y++)
+			for (x = rect.dx; x < rect.dx + rect.width; x++)
+				ref[y * w + x] = rect.rop == ROP_XOR ?
+				                 ref[y * w + x] ^ rect.color :
+				                 rect.color;
+		KUNIT_EXPECT_EQ_MSG(test, men_16z044_KunitDiff4(fbP, ref), 0U,
+		                    "fill rop %u dx %u width %u", rect.rop,
+		                    rect.dx, rect.width);
+	}
+
+	/* copies, the source is read before anything is written */
+	for (i = 0; i < ARRAY_SIZE(copies); i++) {
+		a = &copies[i];
+		men_16z044_copyarea(info, a);
+		for (y = 0; y < a->height; y++)
+			for (x = 0; x < a->width; x++)
+				tmp[y * w + x] =
+					ref[(a->sy + y) * w + a->sx + x];
+		for (y = 0; y < a->height; y++)
+			for (x = 0; x < a->width; x++)
+				ref[(a->dy + y) * w + a->dx + x] =
+					tmp[y * w + x];
+		KUNIT_EXPECT_EQ_MSG(test, men_16z044_KunitDiff4(fbP, ref), 0U,
+		                    "copy %u,%u -> %u,%u width %u", a->sx,
+		                    a->sy, a->dx, a->dy, a->width);
+	}
+
+	/* glyphs at even and odd columns, full and odd widths */
+	memset(&image, 0, sizeof(image));
+	image.height   = KUNIT_GLYPH_H;
+	image.fg_color = KUNIT_FG;
+	image.bg_color = KUNIT_BG;
+	image.depth    = 1;
+	image.data     = G_glyph;
+	image.dy       = 44;
+	for (i = 0; i < ARRAY_SIZE(xs); i++)
+		for (j = KUNIT_GLYPH_W - 1; j <= KUNIT_GLYPH_W; j++) {
+			image.dx    = 100 + xs[i] + j * 2 * KUNIT_GLYPH_W;
+			image.width = j;
+			men_16z044_imageblit(info, &image);
+			for (y = 0; y < image.height; y++)
+				for (x = 0; x < image.width; x++)
+					ref[(image.dy + y) * w + image.dx + x] =
+						G_glyph[y] & (0x80 >> x) ?
+						KUNIT_FG : KUNIT_BG;
+			KUNIT_EXPECT_EQ_MSG(test,
+			                    men_16z044_KunitDiff4(fbP, ref), 0U,
+			                    "glyph dx %u width %u", image.dx,
+			                    image.width);
+		}
+}
+
+/**********************************************************************/
+/** flush of a rotated screen, a rect that is no multiple of the tiles
+ *  lands at the rotated coordinates and nothing around it is written
+ */
+static void men_16z044_TestRotate(struct kunit *test)
+{
+	struct MEN_16Z044_FB *fbP;
+	u32 x1 = 5, y1 = 3, x2 = x1 + 45, y2 = y1 + 37;
+	u32 w, h, x, y, X, Y;
+	u16 *src, pix;
+
+	rotate = *(const unsigned int *)test->param_value;
+	fbP = men_16z044_KunitDevRes(test, 0, 1);
+	w = fbP->xres;
+	h = fbP->yres;
+	src = (u16 *)fbP->shadow;
+	fbP->flush_mt_min = U32_MAX;
+
+	/* nothing but the rect below reaches the SDRAM */
+	men_16z044_Flush(fbP);
+	memset(fbP->sdram_virt, 0, men_16z044_HwFrame(fbP));
+	for (y = 0; y < h; y++)
+		for (x = 0; x < w; x++)
+			src[y * w + x] = y * w + x + 1;
+	men_16z044_Damage(fbP, x1, y1, x2 - x1, y2 - y1);
+	men_16z044_Flush(fbP);
+
+	for (y = y1 - 1; y <= y2; y++)
+		for (x = x1 - 1; x <= x2; x++) {
+			switch (rotate) {
+			case FB_ROTATE_CW:
+				X = h - 1 - y;  Y = x;
+				break;
+			case FB_ROTATE_UD:
+				X = w - 1 - x;  Y = h - 1 - y;
+				break;
+			default: /* FB_ROTATE_CCW */
+				X = y;          Y = w - 1 - x;
+				break;
+			}
+			pix = *(u16 *)(fbP->sdram_virt +
+			               Y * fbP->hw_line_length + X * 2);
+			KUNIT_EXPECT_EQ_MSG(test, pix, x >= x1 && x < x2 &&
+			                    y >= y1 && y < y2 ?
+			                    src[y * w + x] : 0,
+			                    "pixel %u,%u at %u,%u", x, y, X, Y);
+		}
+}
+
+/* name the parameters by resolution */
+static void men_16z044_KunitResDesc(const unsigned int *res, char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "%ux%u-%ubpp", G_resol[*res].xres,
+	         G_resol[*res].yres, G_resol[*res].bits_per_pixel);
+}
+
+KUNIT_ARRAY_PARAM(men_16z044_res, G_kunitRes, men_16z044_KunitResDesc);
+
+static void men_16z044_KunitRotDesc(const unsigned int *rot, char *desc)
+{
+	snprintf(desc, KUNIT_PARAM_DESC_SIZE, "rotate-%u", *rot);
+}
+
+KUNIT_ARRAY_PARAM(men_16z044_rot, G_kunitRot, men_16z044_KunitRotDesc);
+
+static struct kunit_case G_kunitCases[] = {
+	KUNIT_CASE_PARAM(men_16z044_TestSetcolreg,  men_16z044_res_gen_params),
+	KUNIT_CASE_PARAM(men_16z044_TestDrawDirect, men_16z044_res_gen_params),
+	KUNIT_CASE_PARAM(men_16z044_TestDrawShadow, men_16z044_res_gen_params),
+	KUNIT_CASE_PARAM(men_16z044_TestFlush,      men_16z044_res_gen_params),
+	KUNIT_CASE(men_16z044_TestPanel),
+	KUNIT_CASE_PARAM(men_16z044_TestRotate,     men_16z044_rot_gen_params),
+	{}
+};
+
+static struct kunit_suite G_kunitSuite = {
+	.name       = "fb16z044_bench",
+	.init       = men_16z044_KunitInit,
+	.exit       = men_16z044_KunitExit,
+	.test_cases = G_kunitCases,
+};
+
+kunit_test_suite(G_kunitSuite);
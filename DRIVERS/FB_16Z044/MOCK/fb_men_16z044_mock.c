@@ -0,0 +1,407 @@
+/*********************  P r o g r a m  -  M o d u l e ***********************/
+/*!
+ *        \file  fb_men_16z044_mock.c
+ *
+ *     \brief  Mock chameleon FPGA with a 16Z044 display and a Z043 SDRAM
+ *             unit for hardware-free tests of the 16z044 framebuffer
+ *             driver.
+ *
+ *             The module is loaded instead of men_chameleon.ko and offers
+ *             its driver interface (men_chameleonV2_register_driver() etc.)
+ *             with one display unit (devId 44) and one SDRAM unit (devId 43)
+ *             in the same group. Both BARs are RAM: the SDRAM is vmalloc'ed,
+ *             the display controller registers are kept in a page.
+ *             A vblank hrtimer at the selected refresh rate latches the
+ *             control register like the FPGA does: changes flagged with
+ *             Z044_DISP_CTRL_CHANGE and the frame offset take effect at
+ *             the next vblank, Z044_DISP_CTRL_ONOFF stops scanout.
+ *             With res_rw=1 the resolution bits are writable like in
+ *             FPGA variants with runtime mode switching.
+ *
+ *             The driver must be built with driver_mock.mak
+ *             (switch MEN_16Z044_MOCK), e.g.
+ *               insmod men_lx_z44_mock_cham.ko mode=3 sdram_mb=16
+ *               insmod men_lx_z44_mock.ko shadow=1
+ *             State is in /sys/kernel/debug/fb16z044_mock/state.
+ *
+ *     Switches: -
+ */
+/*
+ *---------------------------------------------------------------------------
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+/*
+* This program is free software: you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation, either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+* GNU General Public License for more details.
+*
+* You should have received a copy of the GNU General Public License
+* along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <linux/version.h>
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/errno.h>
+#include <linux/string.h>
+#include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/pci.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/spinlock.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <asm/io.h>
+#include <MEN/men_chameleon.h>
+#include <MEN/16z044_disp.h>
+
+
+/*-----------------------------+
+ |  DEFINES                    |
+ +-----------------------------*/
+/* debug helpers */
+#ifdef DBG
+#define DPRINTK(x...)       printk(x)
+#else
+#define DPRINTK(x...)
+#endif
+
+#define MOCK_NAME                      "fb16z044_mock"
+#define MOCK_BAR_DISP                  0
+#define MOCK_BAR_SDRAM                 1
+#define MOCK_DISP_SIZE                 PAGE_SIZE
+#define MOCK_FP_CTRL                   (0x0C)  /* as in the driver */
+#define MOCK_CTRL_RES_MASK             (0x3)   /* resolution, read only */
+
+
+/*--------------------------------+
+ |  TYPEDEFS                      |
+ +--------------------------------*/
+struct MOCK_16Z044
+{
+	struct pci_bus bus;
+	struct pci_dev pdev;
+	CHAMELEONV2_UNIT_T disp;               /* devId 44 */
+	CHAMELEONV2_UNIT_T sdram;              /* devId 43 */
+	CHAMELEONV2_DRIVER_T *drv;
+
+	void *regs;                            /* BAR0, display controller */
+	void *mem;                             /* BAR1, vmalloc'ed SDRAM */
+	u32 mem_size;
+
+	/* state latched at vblank, i.e. what the "monitor" shows */
+	spinlock_t lock;
+	struct hrtimer vblank;
+	u32 ctrl;                              /* active control register */
+	u32 foffs;                             /* active frame offset */
+	u64 frames;                            /* vblanks since load */
+	u64 scanned;                           /* frames scanned out */
+	u64 commits;                           /* CHANGE requests latched */
+
+	struct dentry *debugfs;
+};
+
+
+/*--------------------------------+
+ |  GLOBALS                       |
+ +--------------------------------*/
+static unsigned int mode = 2;            /* index into G_resol, 1024x768 */
+static unsigned int sdram_mb = 8;
+static unsigned int res_rw;              /* resolution bits writable */
+
+static struct MOCK_16Z044 *G_mock;
+
+
+/**********************************************************************/
+/** register address of the display controller
+ *
+ * \param \IN   reg  offset in the display controller BAR
+ */
+static inline void *mock_reg(u32 reg)
+{
+	return G_mock->regs + reg;
+}
+
+/**********************************************************************/
+/** vblank of the mock display, latch pending changes
+ *
+ * \brief  Runs at 60 or 75 Hz depending on Z044_DISP_CTRL_REFRESH of
+ *         the active control value.
+ */
+static enum hrtimer_restart mock_vblank(struct hrtimer *timer)
+{
+	struct MOCK_16Z044 *m = container_of(timer, struct MOCK_16Z044, vblank);
+	u32 ctrl;
+
+	spin_lock(&m->lock);
+	ctrl = readl(mock_reg(Z044_DISP_CTRL));
+
+	/* resolution is fixed in the FPGA unless res_rw is set */
+	if (!res_rw && (ctrl & MOCK_CTRL_RES_MASK) != mode) {
+		ctrl = (ctrl & ~MOCK_CTRL_RES_MASK) | mode;
+		writel(ctrl, mock_reg(Z044_DISP_CTRL));
+	}
+
+	if (ctrl & Z044_DISP_CTRL_CHANGE) {
+		ctrl &= ~Z044_DISP_CTRL_CHANGE;
+		writel(ctrl, mock_reg(Z044_DISP_CTRL));
+		m->ctrl = ctrl;
+		m->commits++;
+	} else {
+		/* test pattern and byte swapping act without CHANGE */
+		m->ctrl = (m->ctrl & ~(Z044_DISP_CTRL_DEBUG |
+		                       Z044_DISP_CTRL_BYTESWAP)) |
+		          (ctrl & (Z044_DISP_CTRL_DEBUG | Z044_DISP_CTRL_BYTESWAP));
+	}
+	m->foffs = readl(mock_reg(Z044_DISP_FOFFS));
+
+	m->frames++;
+	if (!(m->ctrl & Z044_DISP_CTRL_ONOFF))
+		m->scanned++;
+	spin_unlock(&m->lock);
+
+	hrtimer_forward_now(timer, ns_to_ktime(NSEC_PER_SEC /
+	                    ((m->ctrl & Z044_DISP_CTRL_REFRESH) ? 75 : 60)));
+	return HRTIMER_RESTART;
+}
+
+static int mock_state_show(struct seq_file *s, void *v)
+{
+	struct MOCK_16Z044 *m = s->private;
+	unsigned long flags;
+	u32 ctrl, foffs, fp;
+	u64 frames, scanned, commits;
+
+	spin_lock_irqsave(&m->lock, flags);
+	ctrl    = m->ctrl;
+	foffs   = m->foffs;
+	frames  = m->frames;
+	scanned = m->scanned;
+	commits = m->commits;
+	spin_unlock_irqrestore(&m->lock, flags);
+	fp = readl(mock_reg(Z044_DISP_CTRL + MOCK_FP_CTRL));
+
+	seq_printf(s, "ctrl        0x%08x\n", ctrl);
+	seq_printf(s, "resolution  %u\n", ctrl & MOCK_CTRL_RES_MASK);
+	seq_printf(s, "refresh     %u Hz\n",
+	           (ctrl & Z044_DISP_CTRL_REFRESH) ? 75 : 60);
+	seq_printf(s, "blanked     %u\n", !!(ctrl & Z044_DISP_CTRL_ONOFF));
+	seq_printf(s, "testpattern %u\n", !!(ctrl & Z044_DISP_CTRL_DEBUG));
+	seq_printf(s, "byteswap    %u\n", !!(ctrl & Z044_DISP_CTRL_BYTESWAP));
+	seq_printf(s, "flatpanel   0x%x\n", fp & 0x7);
+	seq_printf(s, "frame_offs  0x%08x\n", foffs);
+	seq_printf(s, "vblanks     %llu\n", (unsigned long long)frames);
+	seq_printf(s, "scanned     %llu\n", (unsigned long long)scanned);
+	seq_printf(s, "commits     %llu\n", (unsigned long long)commits);
+	seq_printf(s, "sdram       %u bytes\n", m->mem_size);
+	return 0;
+}
+
+static int mock_state_open(struct inode *inode, struct file *file)
+{
+	return single_open(file, mock_state_show, inode->i_private);
+}
+
+static const struct file_operations G_stateFops = {
+	.owner   = THIS_MODULE,
+	.open    = mock_state_open,
+	.read    = seq_read,
+	.llseek  = seq_lseek,
+	.release = single_release,
+};
+
+/*-----------------------------------------------------------------------+
+ |  chameleon driver interface, replaces men_chameleon.ko                 |
+ +-----------------------------------------------------------------------*/
+
+/**********************************************************************/
+/** get the address of a BAR of the mock device
+ *
+ * \param \IN   pdev   pci_dev of a mock unit
+ * \param \IN   bar    BAR number
+ * \param \OUT  physP  physical address, 0 for the vmalloc'ed SDRAM
+ * \param \OUT  sizeP  size of the BAR
+ *
+ * \returns virtual address of the BAR or NULL
+ */
+void *men_16z044_mock_bar(struct pci_dev *pdev, int bar, u32 *physP, u32 *sizeP)
+{
+	if (!G_mock || pdev != &G_mock->pdev)
+		return NULL;
+
+	switch (bar) {
+	case MOCK_BAR_DISP:
+		*physP = virt_to_phys(G_mock->regs);
+		*sizeP = MOCK_DISP_SIZE;
+		return G_mock->regs;
+	case MOCK_BAR_SDRAM:
+		*physP = 0;
+		*sizeP = G_mock->mem_size;
+		return G_mock->mem;
+	default:
+		return NULL;
+	}
+}
+EXPORT_SYMBOL_GPL(men_16z044_mock_bar);
+
+/**********************************************************************/
+/** find the idx'th unit with the given device id
+ *
+ * \returns 0 if found, -ENODEV otherwise
+ */
+int men_chameleonV2_unit_find(int devId, int idx, CHAMELEONV2_UNIT_T *unitP)
+{
+	if (!G_mock || idx != 0)
+		return -ENODEV;
+
+	if (devId == G_mock->disp.unitFpga.devId)
+		*unitP = G_mock->disp;
+	else if (devId == G_mock->sdram.unitFpga.devId)
+		*unitP = G_mock->sdram;
+	else
+		return -ENODEV;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(men_chameleonV2_unit_find);
+
+/**********************************************************************/
+/** register a chameleon driver, probe the display unit if it matches
+ *
+ * \returns number of units probed
+ */
+int men_chameleonV2_register_driver(CHAMELEONV2_DRIVER_T *drv)
+{
+	const u16 *id;
+
+	if (!G_mock || G_mock->drv)
+		return 0;
+
+	for (id = drv->devIdArr; *id != CHAMELEONV2_DEVID_END; id++) {
+		if (*id != G_mock->disp.unitFpga.devId)
+			continue;
+		if (drv->probe(&G_mock->disp))
+			return 0;
+		G_mock->drv = drv;
+		return 1;
+	}
+	return 0;
+}
+EXPORT_SYMBOL_GPL(men_chameleonV2_register_driver);
+
+/**********************************************************************/
+/** unregister a chameleon driver, remove its unit
+ */
+void men_chameleonV2_unregister_driver(CHAMELEONV2_DRIVER_T *drv)
+{
+	if (!G_mock || G_mock->drv != drv)
+		return;
+
+	if (drv->remove)
+		drv->remove(&G_mock->disp);
+	G_mock->drv = NULL;
+}
+EXPORT_SYMBOL_GPL(men_chameleonV2_unregister_driver);
+
+/**********************************************************************/
+/** create the mock FPGA
+ *
+ * \returns 0 on success or negative linux error number
+ */
+static int __init mock_16z044_init(void)
+{
+	struct MOCK_16Z044 *m;
+
+	if (mode > MOCK_CTRL_RES_MASK || !sdram_mb) {
+		printk(KERN_ERR "*** %s: invalid mode/sdram_mb\n", MOCK_NAME);
+		return -EINVAL;
+	}
+
+	m = kzalloc(sizeof(*m), GFP_KERNEL);
+	if (!m)
+		return -ENOMEM;
+
+	m->regs     = (void *)get_zeroed_page(GFP_KERNEL);
+	m->mem_size = sdram_mb << 20;
+	m->mem      = vmalloc_user(m->mem_size); /* zeroed, mmap'able */
+	if (!m->regs || !m->mem) {
+		free_page((unsigned long)m->regs);
+		vfree(m->mem);
+		kfree(m);
+		return -ENOMEM;
+	}
+
+	/* power on state of the controller: blanked, selected resolution */
+	m->ctrl = Z044_DISP_CTRL_ONOFF | mode;
+	writel(m->ctrl, m->regs + Z044_DISP_CTRL);
+
+	/* both units in one FPGA behind one PCI function */
+	m->bus.number    = 0xff;
+	m->pdev.bus      = &m->bus;
+	m->pdev.devfn    = 0;
+	m->disp.pdev     = &m->pdev;
+	m->disp.unitFpga.devId  = 44;
+	m->disp.unitFpga.group  = 0;
+	m->disp.unitFpga.bar    = MOCK_BAR_DISP;
+	m->disp.unitFpga.offset = 0;
+	m->sdram.pdev    = &m->pdev;
+	m->sdram.unitFpga.devId  = 43;
+	m->sdram.unitFpga.group  = 0;
+	m->sdram.unitFpga.bar    = MOCK_BAR_SDRAM;
+	m->sdram.unitFpga.offset = 0;
+
+	spin_lock_init(&m->lock);
+	G_mock = m;
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6,15,0)
+	hrtimer_setup(&m->vblank, mock_vblank, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+	hrtimer_init(&m->vblank, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+	m->vblank.function = mock_vblank;
+#endif
+	hrtimer_start(&m->vblank, ns_to_ktime(NSEC_PER_SEC / 60),
+	              HRTIMER_MODE_REL);
+
+	m->debugfs = debugfs_create_dir(MOCK_NAME, NULL);
+	if (!IS_ERR_OR_NULL(m->debugfs))
+		debugfs_create_file("state", 0444, m->debugfs, m, &G_stateFops);
+
+	printk(KERN_INFO "%s: mode %u, %u MB SDRAM\n", MOCK_NAME, mode, sdram_mb);
+	return 0;
+}
+
+/**********************************************************************/
+/** remove the mock FPGA, the fb driver must be unloaded before
+ */
+static void __exit mock_16z044_cleanup(void)
+{
+	struct MOCK_16Z044 *m = G_mock;
+
+	debugfs_remove_recursive(m->debugfs);
+	hrtimer_cancel(&m->vblank);
+	G_mock = NULL;
+	free_page((unsigned long)m->regs);
+	vfree(m->mem);
+	kfree(m);
+}
+
+MODULE_LICENSE("GPL");
+MODULE_AUTHOR("MEN Mikro Elektronik GmbH");
+MODULE_DESCRIPTION("MEN 16z044 mock chameleon device for driver tests");
+MODULE_VERSION(MENT_XSTR(MAK_REVISION));
+
+module_param(mode, uint, 0);
+MODULE_PARM_DESC(mode, "resolution: 0=640x480 1=800x600 2=1024x768 3=1280x1024 ");
+module_param(sdram_mb, uint, 0);
+MODULE_PARM_DESC(sdram_mb, "size of the SDRAM unit in MB ");
+module_param(res_rw, uint, 0);
+MODULE_PARM_DESC(res_rw, "resolution writable by the driver: res_rw=[0 or 1] ");
+
+module_init(mock_16z044_init);
+module_exit(mock_16z044_cleanup);
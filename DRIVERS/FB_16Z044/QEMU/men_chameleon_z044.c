@@ -0,0 +1,526 @@
+/*
+ * MEN chameleon FPGA with a 16Z044 display and a Z043 SDRAM unit
+ *
+ * PCI device model for system level tests of the 16z044 framebuffer
+ * driver together with the real men_chameleon driver:
+ *
+ *   BAR0  chameleon V2 table (16Z044 devId 44, Z043 devId 43, group 1)
+ *   BAR1  Z043 SDRAM, sdram-mb MiB
+ *   BAR2  16Z044 display controller registers
+ *
+ * The display is scanned out to a QEMU console. Control register changes
+ * flagged with CHANGE and the frame offset are latched at the vblank of
+ * the selected refresh rate like the FPGA does, ONOFF blanks the output.
+ *
+ * PCI cost model: with read-latency-ns or write-latency-ns set, every
+ * access to SDRAM and registers goes through MMIO callbacks. Reads are
+ * non-posted, they wait until all posted writes have drained and then
+ * stall the vCPU for read-latency-ns. Writes are posted into a buffer of
+ * posted-writes entries which drains one entry per write-latency-ns, the
+ * vCPU only stalls when the buffer is full. Without latencies the SDRAM
+ * is plain guest RAM with dirty tracking for the scanout.
+ *
+ *   qemu-system-x86_64 ... -device men-chameleon-z044,mode=2,sdram-mb=8,\
+ *       read-latency-ns=1000,write-latency-ns=40
+ *
+ * Copy into hw/display/ of a QEMU 9.1 tree and add Kconfig and
+ * meson.build of this directory to the ones there.
+ * Not modelled: test pattern, byte swapped scanout, interrupts.
+ *
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "qemu/timer.h"
+#include "qemu/module.h"
+#include "qemu/log.h"
+#include "qapi/error.h"
+#include "hw/pci/pci_device.h"
+#include "hw/qdev-properties.h"
+#include "migration/vmstate.h"
+#include "ui/console.h"
+#include "qom/object.h"
+
+#define TYPE_MEN_CHAMELEON_Z044 "men-chameleon-z044"
+OBJECT_DECLARE_SIMPLE_TYPE(MenChamZ044State, MEN_CHAMELEON_Z044)
+
+#define PCI_VENDOR_ID_MEN           0x1a88
+#define PCI_DEVICE_ID_MEN_CHAMELEON 0x4d45
+
+#define CHAM_BAR_TABLE      0
+#define CHAM_BAR_SDRAM      1
+#define CHAM_BAR_DISP       2
+#define CHAM_TABLE_SIZE     0x1000
+#define CHAM_DISP_SIZE      0x1000
+
+/* chameleon V2 table */
+#define CHAM_V2_MAGIC       0xabce
+#define CHAM_DTYPE_GENERAL  0x0
+#define CHAM_DTYPE_END      0xf
+#define CHAM_GDD_SIZE       16
+#define CHAM_HEADER_SIZE    20
+#define CHAM_GROUP          1
+
+/*
+ * 16Z044 registers, offsets in the display unit. Keep in sync with
+ * MEN/16z044_disp.h of the MDIS installation, which can be force
+ * included to override them.
+ */
+#ifndef Z044_DISP_CTRL
+#define Z044_DISP_CTRL              0x00
+#define Z044_DISP_FOFFS             0x04
+#define Z044_DISP_CTRL_REFRESH      (1u << 2)
+#define Z044_DISP_CTRL_DEBUG        (1u << 3)
+#define Z044_DISP_CTRL_BYTESWAP     (1u << 4)
+#define Z044_DISP_CTRL_ONOFF        (1u << 5)
+#define Z044_DISP_CTRL_CHANGE       (1u << 31)
+#endif
+#define Z044_DISP_FP_CTRL           0x0c    /* MEN_16Z044_FP_CTRL */
+#define Z044_DISP_CTRL_RES_MASK     0x3     /* read only */
+
+static const struct {
+    uint16_t xres, yres;
+} men_z044_modes[] = {
+    {  640,  480 },
+    {  800,  600 },
+    { 1024,  768 },
+    { 1280, 1024 },
+};
+
+struct MenChamZ044State {
+    PCIDevice parent_obj;
+
+    MemoryRegion table_bar;
+    MemoryRegion sdram;
+    MemoryRegion disp_bar;
+    uint8_t table[CHAM_TABLE_SIZE];
+    uint8_t *vram;              /* SDRAM contents */
+    bool sdram_mmio;            /* cost model active */
+
+    /* registers as written and as latched at vblank */
+    uint32_t ctrl;
+    uint32_t foffs;
+    uint32_t fp_ctrl;
+    uint32_t ctrl_active;
+    uint32_t foffs_active;
+    QEMUTimer *vblank;
+    uint64_t vblanks;
+
+    /* scanout */
+    QemuConsole *con;
+    bool invalidate;
+    uint32_t shown_foffs;
+    bool shown_blank;
+
+    /* posted write buffer, host monotonic ns */
+    int64_t wbuf_done;
+
+    /* properties */
+    uint32_t mode;
+    uint32_t sdram_mb;
+    uint32_t read_latency_ns;
+    uint32_t write_latency_ns;
+    uint32_t posted_writes;
+};
+
+/* -------------------------------------------------------------------------
+ * PCI cost model
+ */
+static void men_z044_spin_until(int64_t t)
+{
+    while (get_clock() < t) {
+        /* the vCPU is stalled like on a non-posted PCI read */
+    }
+}
+
+static void men_z044_cost_read(MenChamZ044State *s)
+{
+    if (s->wbuf_done > get_clock()) {
+        men_z044_spin_until(s->wbuf_done);
+    }
+    if (s->read_latency_ns) {
+        men_z044_spin_until(get_clock() + s->read_latency_ns);
+    }
+}
+
+static void men_z044_cost_write(MenChamZ044State *s)
+{
+    int64_t now, full_at;
+
+    if (!s->write_latency_ns) {
+        return;
+    }
+    now = get_clock();
+    s->wbuf_done = MAX(now, s->wbuf_done) + s->write_latency_ns;
+    /* stall until the buffer has room again */
+    full_at = s->wbuf_done - (int64_t)s->posted_writes * s->write_latency_ns;
+    if (full_at > now) {
+        men_z044_spin_until(full_at);
+    }
+}
+
+/* -------------------------------------------------------------------------
+ * BAR0, chameleon table
+ */
+static void men_z044_put_gdd(MenChamZ044State *s, int idx, uint32_t dev,
+                             uint32_t bar, uint32_t offset, uint32_t size)
+{
+    uint8_t *p = s->table + CHAM_HEADER_SIZE + idx * CHAM_GDD_SIZE;
+
+    stl_le_p(p, (CHAM_DTYPE_GENERAL << 28) | (dev << 18));
+    stl_le_p(p + 4, (CHAM_GROUP << 9) | bar);
+    stl_le_p(p + 8, offset);
+    stl_le_p(p + 12, size);
+}
+
+static void men_z044_build_table(MenChamZ044State *s)
+{
+    uint8_t *p = s->table;
+
+    memset(s->table, 0, sizeof(s->table));
+    p[0] = 2;                               /* revision */
+    p[1] = 'Q';                             /* model */
+    p[2] = 0;                               /* minor */
+    p[3] = 0;                               /* wishbone */
+    stw_le_p(p + 4, CHAM_V2_MAGIC);
+    memcpy(p + 8, "QEMU_Z044   ", 12);      /* no '\0' */
+
+    men_z044_put_gdd(s, 0, 44, CHAM_BAR_DISP, 0, CHAM_DISP_SIZE);
+    men_z044_put_gdd(s, 1, 43, CHAM_BAR_SDRAM, 0, s->sdram_mb * MiB);
+    stl_le_p(s->table + CHAM_HEADER_SIZE + 2 * CHAM_GDD_SIZE,
+             CHAM_DTYPE_END << 28);
+}
+
+static uint64_t men_z044_table_read(void *opaque, hwaddr addr, unsigned size)
+{
+    MenChamZ044State *s = opaque;
+
+    men_z044_cost_read(s);
+    return ldn_le_p(s->table + addr, size);
+}
+
+static void men_z044_table_write(void *opaque, hwaddr addr, uint64_t val,
+                                 unsigned size)
+{
+    qemu_log_mask(LOG_GUEST_ERROR, "%s: write to chameleon table 0x%" HWADDR_PRIx
+                  "\n", __func__, addr);
+}
+
+static const MemoryRegionOps men_z044_table_ops = {
+    .read = men_z044_table_read,
+    .write = men_z044_table_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = { .min_access_size = 1, .max_access_size = 4 },
+};
+
+/* -------------------------------------------------------------------------
+ * BAR2, 16Z044 display controller
+ */
+static uint64_t men_z044_disp_read(void *opaque, hwaddr addr, unsigned size)
+{
+    MenChamZ044State *s = opaque;
+
+    men_z044_cost_read(s);
+    switch (addr) {
+    case Z044_DISP_CTRL:
+        return s->ctrl;
+    case Z044_DISP_FOFFS:
+        return s->foffs;
+    case Z044_DISP_FP_CTRL:
+        return s->fp_ctrl;
+    default:
+        return 0;
+    }
+}
+
+static void men_z044_disp_write(void *opaque, hwaddr addr, uint64_t val,
+                                unsigned size)
+{
+    MenChamZ044State *s = opaque;
+
+    men_z044_cost_write(s);
+    switch (addr) {
+    case Z044_DISP_CTRL:
+        /* the resolution is fixed in the FPGA */
+        s->ctrl = (val & ~Z044_DISP_CTRL_RES_MASK) | s->mode;
+        break;
+    case Z044_DISP_FOFFS:
+        s->foffs = val;
+        break;
+    case Z044_DISP_FP_CTRL:
+        s->fp_ctrl = val & 0x7;
+        break;
+    default:
+        qemu_log_mask(LOG_GUEST_ERROR, "%s: bad register 0x%" HWADDR_PRIx
+                      "\n", __func__, addr);
+        break;
+    }
+}
+
+static const MemoryRegionOps men_z044_disp_ops = {
+    .read = men_z044_disp_read,
+    .write = men_z044_disp_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = { .min_access_size = 4, .max_access_size = 4 },
+};
+
+/* -------------------------------------------------------------------------
+ * BAR1, Z043 SDRAM behind the cost model
+ */
+static uint64_t men_z044_sdram_read(void *opaque, hwaddr addr, unsigned size)
+{
+    MenChamZ044State *s = opaque;
+
+    men_z044_cost_read(s);
+    return ldn_le_p(s->vram + addr, size);
+}
+
+static void men_z044_sdram_write(void *opaque, hwaddr addr, uint64_t val,
+                                 unsigned size)
+{
+    MenChamZ044State *s = opaque;
+
+    men_z044_cost_write(s);
+    stn_le_p(s->vram + addr, size, val);
+}
+
+static const MemoryRegionOps men_z044_sdram_ops = {
+    .read = men_z044_sdram_read,
+    .write = men_z044_sdram_write,
+    .endianness = DEVICE_LITTLE_ENDIAN,
+    .valid = { .min_access_size = 1, .max_access_size = 8 },
+    .impl = { .min_access_size = 1, .max_access_size = 8 },
+};
+
+/* -------------------------------------------------------------------------
+ * vblank and scanout
+ */
+static int64_t men_z044_frame_ns(MenChamZ044State *s)
+{
+    return NANOSECONDS_PER_SECOND /
+           ((s->ctrl_active & Z044_DISP_CTRL_REFRESH) ? 75 : 60);
+}
+
+static void men_z044_vblank(void *opaque)
+{
+    MenChamZ044State *s = opaque;
+
+    if (s->ctrl & Z044_DISP_CTRL_CHANGE) {
+        s->ctrl &= ~Z044_DISP_CTRL_CHANGE;
+        s->ctrl_active = s->ctrl;
+    }
+    s->foffs_active = s->foffs;
+    s->vblanks++;
+
+    timer_mod(s->vblank, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              men_z044_frame_ns(s));
+}
+
+static void men_z044_invalidate(void *opaque)
+{
+    MenChamZ044State *s = opaque;
+
+    s->invalidate = true;
+}
+
+static void men_z044_update(void *opaque)
+{
+    MenChamZ044State *s = opaque;
+    uint32_t w = men_z044_modes[s->mode].xres;
+    uint32_t h = men_z044_modes[s->mode].yres;
+    uint32_t stride = w * 2, size = stride * h;
+    uint32_t foffs = s->foffs_active;
+    bool blank = s->ctrl_active & Z044_DISP_CTRL_ONOFF;
+    DisplaySurface *surface;
+    DirtyBitmapSnapshot *snap;
+    int y, y1 = -1, y2 = -1;
+
+    if (foffs > s->sdram_mb * MiB - size) {
+        foffs = 0;
+    }
+
+    if (s->invalidate || foffs != s->shown_foffs || blank != s->shown_blank) {
+        if (blank) {
+            surface = qemu_create_displaysurface(w, h);
+            memset(surface_data(surface), 0, surface_stride(surface) * h);
+        } else {
+            surface = qemu_create_displaysurface_from(w, h, PIXMAN_r5g6b5,
+                                                      stride,
+                                                      s->vram + foffs);
+        }
+        dpy_gfx_replace_surface(s->con, surface);
+        s->shown_foffs = foffs;
+        s->shown_blank = blank;
+        s->invalidate  = false;
+        dpy_gfx_update_full(s->con);
+        return;
+    }
+    if (blank) {
+        return;
+    }
+
+    if (s->sdram_mmio) {
+        /* no dirty log through the cost model */
+        dpy_gfx_update_full(s->con);
+        return;
+    }
+    snap = memory_region_snapshot_and_clear_dirty(&s->sdram, foffs, size,
+                                                  DIRTY_MEMORY_VGA);
+    for (y = 0; y < h; y++) {
+        if (memory_region_snapshot_get_dirty(&s->sdram, snap,
+                                             foffs + y * stride, stride)) {
+            if (y1 < 0) {
+                y1 = y;
+            }
+            y2 = y;
+        }
+    }
+    g_free(snap);
+    if (y1 >= 0) {
+        dpy_gfx_update(s->con, 0, y1, w, y2 - y1 + 1);
+    }
+}
+
+static const GraphicHwOps men_z044_gfx_ops = {
+    .invalidate = men_z044_invalidate,
+    .gfx_update = men_z044_update,
+};
+
+/* -------------------------------------------------------------------------
+ * device
+ */
+static void men_z044_reset(DeviceState *dev)
+{
+    MenChamZ044State *s = MEN_CHAMELEON_Z044(dev);
+
+    s->ctrl = s->ctrl_active = s->mode;
+    s->foffs = s->foffs_active = 0;
+    s->fp_ctrl = 0;
+    s->wbuf_done = 0;
+    s->invalidate = true;
+}
+
+static void men_z044_realize(PCIDevice *pdev, Error **errp)
+{
+    MenChamZ044State *s = MEN_CHAMELEON_Z044(pdev);
+    uint64_t sdram_size = (uint64_t)s->sdram_mb * MiB;
+
+    if (s->mode >= ARRAY_SIZE(men_z044_modes)) {
+        error_setg(errp, "mode must be 0..%zu", ARRAY_SIZE(men_z044_modes) - 1);
+        return;
+    }
+    if (!s->sdram_mb || !is_power_of_2(s->sdram_mb) || s->sdram_mb > 256 ||
+        sdram_size < men_z044_modes[s->mode].xres *
+                     men_z044_modes[s->mode].yres * 2) {
+        error_setg(errp, "sdram-mb must be a power of 2 up to 256 that "
+                   "holds one screen");
+        return;
+    }
+    if (!s->posted_writes) {
+        s->posted_writes = 1;
+    }
+
+    men_z044_build_table(s);
+    memory_region_init_io(&s->table_bar, OBJECT(s), &men_z044_table_ops, s,
+                          "men-chameleon-table", CHAM_TABLE_SIZE);
+    memory_region_init_io(&s->disp_bar, OBJECT(s), &men_z044_disp_ops, s,
+                          "men-16z044-disp", CHAM_DISP_SIZE);
+
+    s->sdram_mmio = s->read_latency_ns || s->write_latency_ns;
+    if (s->sdram_mmio) {
+        s->vram = g_malloc0(sdram_size);
+        memory_region_init_io(&s->sdram, OBJECT(s), &men_z044_sdram_ops, s,
+                              "men-z043-sdram", sdram_size);
+    } else {
+        if (!memory_region_init_ram(&s->sdram, OBJECT(s), "men-z043-sdram",
+                                    sdram_size, errp)) {
+            return;
+        }
+        s->vram = memory_region_get_ram_ptr(&s->sdram);
+        memory_region_set_log(&s->sdram, true, DIRTY_MEMORY_VGA);
+    }
+
+    pci_register_bar(pdev, CHAM_BAR_TABLE, PCI_BASE_ADDRESS_SPACE_MEMORY,
+                     &s->table_bar);
+    pci_register_bar(pdev, CHAM_BAR_SDRAM, PCI_BASE_ADDRESS_SPACE_MEMORY,
+                     &s->sdram);
+    pci_register_bar(pdev, CHAM_BAR_DISP, PCI_BASE_ADDRESS_SPACE_MEMORY,
+                     &s->disp_bar);
+
+    s->con = graphic_console_init(DEVICE(pdev), 0, &men_z044_gfx_ops, s);
+    qemu_console_resize(s->con, men_z044_modes[s->mode].xres,
+                        men_z044_modes[s->mode].yres);
+
+    s->vblank = timer_new_ns(QEMU_CLOCK_VIRTUAL, men_z044_vblank, s);
+    timer_mod(s->vblank, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+              NANOSECONDS_PER_SECOND / 60);
+}
+
+static void men_z044_exit(PCIDevice *pdev)
+{
+    MenChamZ044State *s = MEN_CHAMELEON_Z044(pdev);
+
+    timer_free(s->vblank);
+    graphic_console_close(s->con);
+    if (s->sdram_mmio) {
+        g_free(s->vram);
+    }
+}
+
+/* the cost model buffer is not migrated */
+static const VMStateDescription vmstate_men_z044 = {
+    .name = TYPE_MEN_CHAMELEON_Z044,
+    .unmigratable = 1,
+};
+
+static Property men_z044_properties[] = {
+    DEFINE_PROP_UINT32("mode", MenChamZ044State, mode, 2),
+    DEFINE_PROP_UINT32("sdram-mb", MenChamZ044State, sdram_mb, 8),
+    DEFINE_PROP_UINT32("read-latency-ns", MenChamZ044State,
+                       read_latency_ns, 0),
+    DEFINE_PROP_UINT32("write-latency-ns", MenChamZ044State,
+                       write_latency_ns, 0),
+    DEFINE_PROP_UINT32("posted-writes", MenChamZ044State, posted_writes, 16),
+    DEFINE_PROP_END_OF_LIST(),
+};
+
+static void men_z044_class_init(ObjectClass *klass, void *data)
+{
+    DeviceClass *dc = DEVICE_CLASS(klass);
+    PCIDeviceClass *k = PCI_DEVICE_CLASS(klass);
+
+    k->realize = men_z044_realize;
+    k->exit = men_z044_exit;
+    k->vendor_id = PCI_VENDOR_ID_MEN;
+    k->device_id = PCI_DEVICE_ID_MEN_CHAMELEON;
+    k->class_id = PCI_CLASS_DISPLAY_OTHER;
+    dc->desc = "MEN chameleon FPGA with 16Z044 display and Z043 SDRAM";
+    dc->vmsd = &vmstate_men_z044;
+    device_class_set_legacy_reset(dc, men_z044_reset);
+    device_class_set_props(dc, men_z044_properties);
+    set_bit(DEVICE_CATEGORY_DISPLAY, dc->categories);
+}
+
+static const TypeInfo men_z044_info = {
+    .name = TYPE_MEN_CHAMELEON_Z044,
+    .parent = TYPE_PCI_DEVICE,
+    .instance_size = sizeof(MenChamZ044State),
+    .class_init = men_z044_class_init,
+    .interfaces = (InterfaceInfo[]) {
+        { INTERFACE_CONVENTIONAL_PCI_DEVICE },
+        { },
+    },
+};
+
+static void men_z044_register_types(void)
+{
+    type_register_static(&men_z044_info);
+}
+
+type_init(men_z044_register_types)
@@ -26,10 +26,14 @@
 #include <fcntl.h>
 #include <getopt.h>
 #include <math.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/fb.h>
+#include "../../../../INCLUDE/NATIVE/MEN/fb_men_16z044.h"
 
 #include "logos.h"
 
@@ -134,6 +138,66 @@ static int display_waves(int fd, char *image, unsigned long size, int delay, int
 	return 0;
 }
 
+/* Preloads 'frames' wave pictures into off-screen SDRAM once and lets the
+   driver show them in turn by frame offset: while it plays neither the CPU
+   nor the bus are loaded. Row and column shift wrap after 'frames', so
+   the loop is seamless. Plays as long as display_waves() would. */
+static int display_waves_vram(int fd, char *image, int delay, int iterations,
+                              int frames) {
+	struct men_16z044_surface surf;
+	struct men_16z044_surf_upload up;
+	struct men_16z044_anim anim;
+	__u32 *handles;
+	char *picture;
+	int i, n, ret = -1;
+	dbg_warnx("Preloading %d wave frames into SDRAM", frames);
+	picture = malloc(ROWS * COLUMNS_BASEPIC);
+	handles = calloc(frames, sizeof(*handles));
+	if (!picture || !handles)
+		err(1, "Cannot allocate wave frames");
+	create_base_picture(picture);
+	for (n = 0; n < frames; n++) {
+		memset(&surf, 0, sizeof(surf));
+		surf.width  = COLUMNS_FB;
+		surf.height = ROWS;
+		if (ioctl(fd, FBIO_MEN_16Z044_SURF_ALLOC, &surf)) {
+			warn("Allocating frame %d in SDRAM failed", n);
+			goto out;
+		}
+		handles[n] = surf.handle;
+		prepare_fb(picture, image, 48, n * ROWS / frames,
+		           -(n * COLUMNS_BASEPIC / frames));
+		memset(&up, 0, sizeof(up));
+		up.handle = surf.handle;
+		up.width  = COLUMNS_FB;
+		up.height = ROWS;
+		up.pitch  = COLUMNS_FB / 2;
+		up.data   = (uintptr_t)image;
+		if (ioctl(fd, FBIO_MEN_16Z044_SURF_UPLOAD, &up)) {
+			warn("Uploading frame %d failed", n);
+			n++;
+			goto out;
+		}
+	}
+	anim.interval_ms = delay / 25000 ? delay / 25000 : 1;
+	anim.count       = frames;
+	anim.handles     = (uintptr_t)handles;
+	if (ioctl(fd, FBIO_MEN_16Z044_ANIM_START, &anim)) {
+		warn("Starting the animation failed");
+		goto out;
+	}
+	for (i = 0; i < iterations * 100; i++)
+		usleep(delay / 25);
+	ioctl(fd, FBIO_MEN_16Z044_ANIM_STOP);
+	ret = 0;
+out:
+	while (n--)
+		ioctl(fd, FBIO_MEN_16Z044_SURF_FREE, &handles[n]);
+	free(handles);
+	free(picture);
+	return ret;
+}
+
 /* Writes an image to the framebuffer device and waits 'delay' msecs. If
    images point to NULL it creates a image on the fly with all bytes
    set to 'value'. Note that 1 byte is 2 pixels. */
@@ -172,11 +236,42 @@ static int display_logos(int fd, char *buffer, unsigned long size, int delay,
 	return 0;
 }
 
+/* Loads a gray palette: index i is shown at level brightness * (i/15)^gamma,
+   all 16 entries with one FBIOPUTCMAP. */
+static int set_gray_palette(int fd, double brightness, double gamma) {
+	__u16 level[16];
+	struct fb_cmap cmap = { 0, 16, level, level, level, NULL };
+	int i;
+	for (i = 0; i < 16; i++)
+		level[i] = 0xffff * brightness * pow(i / 15.0, gamma);
+	return ioctl(fd, FBIOPUTCMAP, &cmap);
+}
+
+/* Fades the whole display by changing just the palette, the frame is
+   written once. Falls back to rewriting the frame for every step if the
+   driver has no palette at 4bpp. */
 static int display_var_brightness(int fd, char *buffer, unsigned long size,
-                                  int delay, int iterations) {
+                                  int delay, int iterations, double gamma) {
 	int i;
 	char value;
 	dbg_warnx("Writing varying brightness to framebuffer");
+	if (!set_gray_palette(fd, 1.0, gamma)) {
+		if (display_write(fd, buffer, size, NULL, 0xFF, 0, NULL))
+			return 1;
+		for (i = 0; i < iterations * 32; i++) {
+			value = i % 32;
+			if (value > 15)
+				value = 31 - value;
+			if (set_gray_palette(fd, value / 15.0, gamma)) {
+				warn("Setting the palette failed");
+				return 1;
+			}
+			usleep(delay/10);
+		}
+		/* back to the raw nibbles */
+		return set_gray_palette(fd, 1.0, 1.0) ? 1 : 0;
+	}
+	dbg_warnx("No palette, rewriting the framebuffer");
 	for (i = 0; i < iterations * 32; i++) {
 		value  = i % 32;
 		if (value > 15)
@@ -192,8 +287,10 @@ static int display_var_brightness(int fd, char *buffer, unsigned long size,
 static void usage(char *argv0)
 {
 	printf("Usage: %s -d <device> [options]\n", argv0);
+	printf("  -a <frames>  Play the waves from frames preloaded in SDRAM\n");
 	printf("  -b           Show varying brightness\n");
 	printf("  -d <device>  Framebuffer device\n");
+	printf("  -g <gamma>   Gamma of the brightness fade (default 1.0)\n");
 	printf("  -i           Number of iterations\n");
 	printf("  -l           Show logos\n");
 	printf("  -s           Delay between images in ms (default 500)\n");
@@ -217,19 +314,27 @@ int main(int argc, char **argv)
 	int show_logos = 0;
 	int show_waves = 0;
 	int show_brightness = 0;
+	int anim_frames = 0;
+	double gamma = 1.0;
 
 	/* TODO: better check our rights to read/write to the device node */
 	if (getuid())
 		errx(1, "Must be root to run this program.");
 
-	while ((opt = getopt(argc, argv, "bd:hi:ls:vw")) != -1) {
+	while ((opt = getopt(argc, argv, "a:bd:g:hi:ls:vw")) != -1) {
 		switch (opt) {
+		case 'a':
+			anim_frames = atoi(optarg);
+			break;
 		case 'b':
 			show_brightness = 1;
 			break;
 		case 'd':
 			dev_node = optarg;
 			break;
+		case 'g':
+			gamma = atof(optarg);
+			break;
 		case 'i':
 			iterations = atoi(optarg);
 			break;
@@ -267,13 +372,17 @@ int main(int argc, char **argv)
 
 	if (show_brightness)
 		retval = display_var_brightness(fb_devnode_fd, buffer,
-		                                screensize, delay, iterations);
+		                                screensize, delay, iterations,
+		                                gamma);
 
 	if (show_logos)
 		retval = display_logos(fb_devnode_fd, buffer, screensize,
 		                       delay, iterations);
 
-	if (show_waves)
+	if (show_waves && anim_frames > 0)
+		retval = display_waves_vram(fb_devnode_fd, buffer, delay,
+		                            iterations, anim_frames);
+	else if (show_waves)
 		retval = display_waves(fb_devnode_fd, buffer, screensize,
 		                       delay, iterations);
 
@@ -22,6 +22,7 @@ STAMPED_REVISION="13Z044-90_01_08-18-g6ebc5a9_2020-01-08"
 
 DEF_REVISION=MAK_REVISION=$(STAMPED_REVISION)
 MAK_SWITCH=$(SW_PREFIX)$(DEF_REVISION)
-MAK_INCL=$(MEN_LIN_DIR)/DRIVERS/FB_16Z044/TOOLS/Z44_256X64_TEST/logos.h
+MAK_INCL=$(MEN_LIN_DIR)/DRIVERS/FB_16Z044/TOOLS/Z44_256X64_TEST/logos.h \
+         $(MEN_LIN_DIR)/INCLUDE/NATIVE/MEN/fb_men_16z044.h
 MAK_INP1=$(MAK_NAME)$(INP_SUFFIX)
 MAK_INP=$(MAK_INP1)
@@ -0,0 +1,285 @@
+/*****************************************************************************
+ * Replay an access capture of the 16z044 framebuffer driver
+ *
+ * The driver records register accesses and SDRAM write/read ranges when
+ * loaded with capture=<records>. Save a capture with
+ *   cat /sys/kernel/debug/fb16z044_0/capture > flood.cap
+ * and replay it against a RAM buffer or any framebuffer device (e.g. the
+ * mock device) to get throughput and write amplification of the workload.
+ *
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+ /*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <err.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/fb.h>
+#include "../../../../INCLUDE/NATIVE/MEN/fb_men_16z044.h"
+
+int dbg = 0;
+#define dbg_warnx(format, ...) do {               \
+	if (dbg)                                  \
+		warnx(format, ##  __VA_ARGS__ );  \
+	} while(0)
+
+/* replay target, RAM buffer or mmap'ed framebuffer */
+struct target {
+	unsigned char *mem;
+	unsigned long size;
+	int fd;
+};
+
+/* results per record type, index MEN_16Z044_CAP_* */
+#define CAP_TYPES 6
+static const char *type_names[CAP_TYPES] = {
+	"?", "reg read", "reg write", "frame offs", "sdram write", "sdram read"
+};
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void sleep_until(uint64_t ns)
+{
+	struct timespec ts;
+
+	ts.tv_sec  = ns / 1000000000ULL;
+	ts.tv_nsec = ns % 1000000000ULL;
+	clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL);
+}
+
+/* mark the pixels of a range as written, return how many were new */
+static unsigned long mark_written(unsigned char *map, unsigned long first,
+                                  unsigned long count)
+{
+	unsigned long i, fresh = 0;
+
+	for (i = first; i < first + count; i++) {
+		if (!(map[i >> 3] & (1 << (i & 7)))) {
+			map[i >> 3] |= 1 << (i & 7);
+			fresh++;
+		}
+	}
+	return fresh;
+}
+
+static void open_target(struct target *t, const char *dev, unsigned long size)
+{
+	struct fb_fix_screeninfo finfo;
+
+	t->fd = -1;
+	if (!dev) {
+		t->size = size;
+		t->mem  = calloc(1, size);
+		if (!t->mem)
+			err(1, "Cannot allocate %lu bytes RAM target", size);
+		return;
+	}
+
+	t->fd = open(dev, O_RDWR);
+	if (t->fd == -1)
+		err(1, "Cannot open framebuffer device %s", dev);
+	if (ioctl(t->fd, FBIOGET_FSCREENINFO, &finfo))
+		err(1, "Error reading fixed screen information");
+	t->size = finfo.smem_len;
+	t->mem  = mmap(0, t->size, PROT_READ | PROT_WRITE, MAP_SHARED,
+	               t->fd, 0);
+	if (t->mem == MAP_FAILED)
+		err(1, "Failed to map framebuffer to memory");
+	if (t->size < size)
+		warnx("%s has %lu bytes, capture %lu, ranges are clipped",
+		      dev, t->size, size);
+}
+
+static void usage(char *argv0)
+{
+	printf("Usage: %s [options] <capture file>\n", argv0);
+	printf("  -d <device>  Replay into framebuffer device (default RAM)\n");
+	printf("  -n <count>   Replay the capture <count> times (default 1)\n");
+	printf("  -r           Keep the recorded timing\n");
+	printf("  -v           Verbose output\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct men_16z044_cap_hdr hdr;
+	struct men_16z044_cap_rec *recs;
+	struct target tgt;
+	unsigned long nrecs, n, row, len, offs;
+	unsigned long count[CAP_TYPES] = { 0 };
+	unsigned long long bytes_wr = 0, bytes_rd = 0, pixels_new = 0;
+	unsigned char *written, *scratch;
+	unsigned char pattern = 0;
+	uint64_t t_start, t_end, rec0;
+	double secs, span;
+	char *dev_node = NULL;
+	int realtime = 0, loops = 1, loop;
+	long fsize;
+	FILE *fp;
+
+	extern char *optarg;
+	extern int optind;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "d:hn:rv")) != -1) {
+		switch (opt) {
+		case 'd':
+			dev_node = optarg;
+			break;
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		case 'r':
+			realtime = 1;
+			break;
+		case 'v':
+			dbg = 1;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+	if (optind != argc - 1 || loops < 1)
+		usage(argv[0]);
+
+	fp = fopen(argv[optind], "rb");
+	if (!fp)
+		err(1, "Cannot open capture %s", argv[optind]);
+	if (fread(&hdr, sizeof(hdr), 1, fp) != 1)
+		errx(1, "Capture too short");
+	if (hdr.magic != MEN_16Z044_CAP_MAGIC ||
+	    hdr.version != MEN_16Z044_CAP_VERSION)
+		errx(1, "No 16z044 capture (magic 0x%08x version %u)",
+		     hdr.magic, hdr.version);
+	if (!hdr.line_length || !hdr.bytes_per_pixel || !hdr.sdram_size)
+		errx(1, "Invalid capture header");
+
+	fseek(fp, 0, SEEK_END);
+	fsize = ftell(fp);
+	nrecs = (fsize - sizeof(hdr)) / sizeof(*recs);
+	fseek(fp, sizeof(hdr), SEEK_SET);
+	recs = malloc(nrecs * sizeof(*recs) + 1);
+	if (!recs)
+		err(1, "Cannot allocate records");
+	if (fread(recs, sizeof(*recs), nrecs, fp) != nrecs)
+		errx(1, "Error reading records");
+	fclose(fp);
+
+	printf("capture: %ux%u line_length %u sdram %u bytes, %lu records"
+	       " (%u lost)\n", hdr.xres, hdr.yres, hdr.line_length,
+	       hdr.sdram_size, nrecs, hdr.lost);
+	if (!nrecs)
+		return 0;
+
+	open_target(&tgt, dev_node, hdr.sdram_size);
+	written = calloc(1, hdr.sdram_size / hdr.bytes_per_pixel / 8 + 1);
+	scratch = malloc(hdr.line_length);
+	if (!written || !scratch)
+		err(1, "Cannot allocate buffers");
+
+	rec0    = recs[0].ns;
+	t_start = now_ns();
+	for (loop = 0; loop < loops; loop++) {
+		uint64_t t_loop = now_ns();
+
+		for (n = 0; n < nrecs; n++) {
+			struct men_16z044_cap_rec *rec = &recs[n];
+
+			if (realtime)
+				sleep_until(t_loop + (rec->ns - rec0));
+			count[rec->type < CAP_TYPES ? rec->type : 0]++;
+
+			if (rec->type != MEN_16Z044_CAP_SDRAM_WR &&
+			    rec->type != MEN_16Z044_CAP_SDRAM_RD)
+				continue;
+
+			for (row = 0; row < rec->rows; row++) {
+				offs = rec->offs + row * hdr.line_length;
+				if (offs >= tgt.size)
+					break;
+				len = rec->val;
+				if (len > tgt.size - offs)
+					len = tgt.size - offs;
+				if (len > hdr.line_length)
+					len = hdr.line_length;
+
+				if (rec->type == MEN_16Z044_CAP_SDRAM_RD) {
+					memcpy(scratch, tgt.mem + offs, len);
+					bytes_rd += len;
+					continue;
+				}
+				memset(tgt.mem + offs, pattern, len);
+				bytes_wr += len;
+				pixels_new += mark_written(written,
+				                           offs / hdr.bytes_per_pixel,
+				                           len / hdr.bytes_per_pixel);
+			}
+			pattern++;
+		}
+	}
+	t_end = now_ns();
+
+	secs = (t_end - t_start) / 1e9;
+	span = (recs[nrecs - 1].ns - rec0) / 1e9;
+
+	for (n = 1; n < CAP_TYPES; n++)
+		printf("%-12s %10lu\n", type_names[n], count[n] / loops);
+	if (count[0])
+		printf("%-12s %10lu\n", "unknown", count[0] / loops);
+
+	printf("recorded span      %12.6f s\n", span);
+	printf("replay time        %12.6f s (%d loop%s%s)\n", secs, loops,
+	       loops > 1 ? "s" : "", realtime ? ", recorded timing" : "");
+	printf("bytes written      %12llu (%.2f MB/s)\n", bytes_wr,
+	       secs > 0 ? bytes_wr / secs / 1e6 : 0.0);
+	printf("bytes read back    %12llu (%.2f MB/s)\n", bytes_rd,
+	       secs > 0 ? bytes_rd / secs / 1e6 : 0.0);
+	/* bytes written per distinct byte that changed */
+	printf("write amplification %11.2f\n", pixels_new ?
+	       (double)bytes_wr / (pixels_new * hdr.bytes_per_pixel) : 0.0);
+	if (span > 0)
+		printf("recorded upload    %12.2f MB/s\n",
+		       bytes_wr / loops / span / 1e6);
+
+	dbg_warnx("target %s, %lu bytes", dev_node ? dev_node : "RAM",
+	          tgt.size);
+	if (tgt.fd != -1) {
+		munmap(tgt.mem, tgt.size);
+		close(tgt.fd);
+	} else {
+		free(tgt.mem);
+	}
+	free(written);
+	free(scratch);
+	free(recs);
+	return 0;
+}
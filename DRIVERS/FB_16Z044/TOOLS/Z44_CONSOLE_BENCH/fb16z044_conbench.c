@@ -0,0 +1,278 @@
+/*****************************************************************************
+ * Console throughput benchmark, helper of fb16z044_conbench.sh
+ *
+ * Writes a deterministic flood of text to a virtual terminal: short
+ * lines, long wrapping lines and lines full of colour escapes, like boot
+ * logs and shell output do. Prints characters per second and scrolled
+ * lines per second of every phase and of the whole run.
+ *
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+ /*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <err.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+
+int dbg = 0;
+#define dbg_warnx(format, ...) do {               \
+	if (dbg)                                  \
+		warnx(format, ##  __VA_ARGS__ );  \
+	} while(0)
+
+#define CHUNK           4096         /* bytes per write() */
+
+/* output buffer and what it will do on the console */
+struct flood {
+	char *buf;
+	size_t len;
+	size_t size;
+	unsigned long chars;         /* printable characters */
+	unsigned long lines;         /* screen lines incl. wrapped ones */
+	unsigned int col;            /* cursor column while generating */
+};
+
+static unsigned int cols = 80, rows = 25;
+static uint32_t seed = 0x16044;
+
+/* deterministic pseudo random numbers, same flood on every run */
+static uint32_t rnd(void)
+{
+	seed = seed * 1103515245u + 12345u;
+	return seed >> 8;
+}
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void put(struct flood *f, const char *s, size_t n, int printable)
+{
+	if (f->len + n > f->size) {
+		f->size = (f->len + n) * 2;
+		f->buf = realloc(f->buf, f->size);
+		if (!f->buf)
+			err(1, "Cannot allocate %zu bytes", f->size);
+	}
+	memcpy(f->buf + f->len, s, n);
+	f->len += n;
+	if (!printable)
+		return;
+
+	/* the console wraps at cols */
+	f->chars += n;
+	f->col   += n;
+	while (f->col > cols) {
+		f->col -= cols;
+		f->lines++;
+	}
+}
+
+static void newline(struct flood *f)
+{
+	put(f, "\r\n", 2, 0);
+	f->lines++;
+	f->col = 0;
+}
+
+static void word(struct flood *f)
+{
+	char w[16];
+	unsigned int i, n = 2 + rnd() % 8;
+
+	for (i = 0; i < n; i++)
+		w[i] = 'a' + rnd() % 26;
+	w[n] = ' ';
+	put(f, w, n + 1, 1);
+}
+
+/* log like lines shorter than the screen */
+static void gen_short(struct flood *f, unsigned int n)
+{
+	char pfx[32];
+	unsigned int i, len;
+
+	for (i = 0; i < n; i++) {
+		len = snprintf(pfx, sizeof(pfx), "[%5u.%06u] ", i / 100,
+		               (i % 100) * 10000);
+		put(f, pfx, len, 1);
+		while (f->col + 10 < cols * 3 / 4)
+			word(f);
+		newline(f);
+	}
+}
+
+/* lines of two to four screen widths */
+static void gen_long(struct flood *f, unsigned int n)
+{
+	unsigned long start;
+	unsigned int i, len;
+
+	for (i = 0; i < n; i++) {
+		len = cols * (2 + rnd() % 3) - 12;
+		start = f->chars;
+		while (f->chars - start < len)
+			word(f);
+		newline(f);
+	}
+}
+
+/* ls --color / dmesg --color style output */
+static void gen_colour(struct flood *f, unsigned int n)
+{
+	char esc[16];
+	unsigned int i, len;
+
+	for (i = 0; i < n; i++) {
+		while (f->col + 10 < cols * 3 / 4) {
+			len = snprintf(esc, sizeof(esc), "\033[%u;%um",
+			               rnd() % 2, 30 + rnd() % 8);
+			put(f, esc, len, 0);
+			word(f);
+		}
+		put(f, "\033[0m", 4, 0);
+		newline(f);
+	}
+}
+
+/* write the flood, returns seconds */
+static double run(int fd, struct flood *f)
+{
+	size_t done = 0, n;
+	ssize_t w;
+	double t0 = now_s();
+
+	while (done < f->len) {
+		n = f->len - done < CHUNK ? f->len - done : CHUNK;
+		w = write(fd, f->buf + done, n);
+		if (w < 0)
+			err(1, "write to console failed");
+		done += w;
+	}
+	tcdrain(fd);
+	return now_s() - t0;
+}
+
+static void result(const char *phase, struct flood *f, double secs,
+                   int from_empty)
+{
+	/* lines scroll once the screen is full */
+	unsigned long scrolled = f->lines;
+
+	if (from_empty)
+		scrolled = scrolled > rows ? scrolled - rows : 0;
+
+	printf("%-8s chars %9lu lines %7lu bytes %9zu secs %8.3f "
+	       "chars/s %10.0f scroll_lines/s %8.0f\n", phase, f->chars,
+	       f->lines, f->len, secs, secs > 0 ? f->chars / secs : 0.0,
+	       secs > 0 ? scrolled / secs : 0.0);
+}
+
+static void usage(char *argv0)
+{
+	printf("Usage: %s [options]\n", argv0);
+	printf("  -t <tty>     Console to write to (default /dev/tty)\n");
+	printf("  -n <lines>   Lines per phase (default 2000)\n");
+	printf("  -s <seed>    Seed of the text generator\n");
+	printf("  -v           Verbose output\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	static const char *phases[] = { "short", "long", "colour" };
+	struct flood f[3], total;
+	struct winsize ws;
+	double secs[3], sum = 0;
+	char *tty = "/dev/tty";
+	unsigned int lines = 2000;
+	uint32_t seed0;
+	int fd, i;
+
+	extern char *optarg;
+	extern int optind;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "hn:s:t:v")) != -1) {
+		switch (opt) {
+		case 'n':
+			lines = strtoul(optarg, NULL, 0);
+			break;
+		case 's':
+			seed = strtoul(optarg, NULL, 0);
+			break;
+		case 't':
+			tty = optarg;
+			break;
+		case 'v':
+			dbg = 1;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+	if (optind != argc || !lines)
+		usage(argv[0]);
+
+	fd = open(tty, O_WRONLY | O_NOCTTY);
+	if (fd == -1)
+		err(1, "Cannot open %s", tty);
+	if (!ioctl(fd, TIOCGWINSZ, &ws) && ws.ws_col && ws.ws_row) {
+		cols = ws.ws_col;
+		rows = ws.ws_row;
+	}
+	dbg_warnx("%s: %ux%u characters", tty, cols, rows);
+
+	seed0 = seed;
+	memset(f, 0, sizeof(f));
+	gen_short(&f[0], lines);
+	gen_long(&f[1], lines / 4);
+	gen_colour(&f[2], lines);
+
+	/* clear screen and home, the first phase starts on an empty screen */
+	if (write(fd, "\033[H\033[2J", 7) < 0)
+		err(1, "write to console failed");
+	for (i = 0; i < 3; i++)
+		secs[i] = run(fd, &f[i]);
+
+	printf("console %s %ux%u seed 0x%x\n", tty, cols, rows, seed0);
+	memset(&total, 0, sizeof(total));
+	for (i = 0; i < 3; i++) {
+		result(phases[i], &f[i], secs[i], !i);
+		total.chars += f[i].chars;
+		total.lines += f[i].lines;
+		total.len   += f[i].len;
+		sum         += secs[i];
+		free(f[i].buf);
+	}
+	result("total", &total, sum, 1);
+	close(fd);
+	return 0;
+}
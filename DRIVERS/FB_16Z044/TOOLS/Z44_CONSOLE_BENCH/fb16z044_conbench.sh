@@ -0,0 +1,74 @@
+#!/bin/sh
+#*****************************************************************************
+# Console throughput benchmark of the 16z044 framebuffer
+#
+# Switches to a virtual terminal on the 16z044 fb, floods it with the
+# deterministic text of fb16z044_conbench and prints characters/s and
+# scrolled lines/s together with the driver counters (debugfs stats and
+# latency, sysfs flush_stats) collected during the run. The last line
+# "score <chars/s>" is the number to compare driver builds with.
+#
+#   fb16z044_conbench.sh [-c <vt>] [-f <fbN>] [-n <lines>] [-d <debugfs dir>]
+#
+# Copyright 2020, MEN Mikro Elektronik GmbH
+#*****************************************************************************
+# This program is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 2 of the License, or
+# (at your option) any later version.
+#
+# This program is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with this program.  If not, see <http://www.gnu.org/licenses/>.
+
+VT=2
+FB=fb0
+LINES=2000
+DBGFS=/sys/kernel/debug/fb16z044_0
+HELPER=${HELPER:-$(dirname "$0")/fb16z044_conbench}
+
+usage() {
+	echo "Usage: $0 [-c <vt>] [-f <fbN>] [-n <lines>] [-d <debugfs dir>]"
+	exit 1
+}
+
+while getopts "c:d:f:n:h" opt; do
+	case $opt in
+	c) VT=$OPTARG ;;
+	d) DBGFS=$OPTARG ;;
+	f) FB=$OPTARG ;;
+	n) LINES=$OPTARG ;;
+	*) usage ;;
+	esac
+done
+
+[ -x "$HELPER" ] || HELPER=fb16z044_conbench
+command -v "$HELPER" >/dev/null 2>&1 || { echo "$HELPER not found"; exit 1; }
+[ -c /dev/tty$VT ] || { echo "no /dev/tty$VT"; exit 1; }
+
+SYSFS=/sys/class/graphics/$FB
+if [ -r $SYSFS/name ]; then
+	echo "$FB: $(cat $SYSFS/name) $(cat $SYSFS/virtual_size 2>/dev/null)"
+fi
+[ -d $DBGFS ] || echo "no $DBGFS, driver counters not collected"
+[ -w $DBGFS/reset ] && echo 1 > $DBGFS/reset
+
+OLDVT=$(fgconsole 2>/dev/null)
+chvt $VT || exit 1
+OUT=$("$HELPER" -t /dev/tty$VT -n $LINES)
+RC=$?
+[ -n "$OLDVT" ] && chvt $OLDVT
+[ $RC -eq 0 ] || exit $RC
+
+echo "$OUT"
+for f in $DBGFS/stats $DBGFS/latency; do
+	[ -r $f ] && { echo "--- $f"; cat $f; }
+done
+for f in $SYSFS/flush_stats $SYSFS/access_calib; do
+	[ -r $f ] && { echo "--- $f"; cat $f; }
+done
+echo "$OUT" | awk '$1 == "total" { print "score " $11 }'
@@ -0,0 +1,512 @@
+/*****************************************************************************
+ * Benchmark a framebuffer device
+ *
+ * Measures full frame write() and mmap throughput, partial rect update
+ * latency, pan/flip latency, ioctl round trips of the FBIO_* commands and
+ * readback bandwidth of any /dev/fbN (16z044, mock device, vfb).
+ * Every test is warmed up and repeated, the results are printed with
+ * percentiles as text, CSV or JSON to track regressions across driver
+ * builds and boards, e.g.
+ *   fb16z044_bench -d /dev/fb0 -n 200 -o csv > board_a.csv
+ *
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+ /*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <linux/fb.h>
+#include "../../../../INCLUDE/NATIVE/MEN/fb_men_16z044.h"
+
+int dbg = 0;
+#define dbg_warnx(format, ...) do {               \
+	if (dbg)                                  \
+		warnx(format, ##  __VA_ARGS__ );  \
+	} while(0)
+
+enum out_fmt { OUT_TEXT, OUT_CSV, OUT_JSON };
+
+/* device under test */
+struct fbdev {
+	const char *node;
+	int fd;
+	struct fb_fix_screeninfo fix;
+	struct fb_var_screeninfo var;
+	unsigned char *mem;          /* mmap of smem_len */
+	unsigned long frame;         /* bytes of the visible frame */
+	unsigned char *buf;          /* RAM source / sink of one frame */
+	unsigned char *saved;        /* visible frame before the run */
+};
+
+/* benchmark settings */
+struct bench {
+	int warmup;
+	int reps;
+	unsigned int rect_w;
+	unsigned int rect_h;
+	int all_ioctls;
+	enum out_fmt fmt;
+	int results;                 /* results printed so far */
+	uint64_t *ns;                /* samples of the current test */
+};
+
+/* one repetition of a test, returns bytes moved or -1 if not supported */
+typedef long (*test_fn)(struct fbdev *fb, struct bench *b, int rep);
+
+static uint64_t now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int cmp_u64(const void *a, const void *b)
+{
+	uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+
+	return x < y ? -1 : x > y;
+}
+
+/* nearest rank percentile of sorted samples */
+static uint64_t percentile(const uint64_t *s, int n, int p)
+{
+	int i = (p * n + 99) / 100 - 1;
+
+	return s[i < 0 ? 0 : i];
+}
+
+static void print_header(struct fbdev *fb, struct bench *b)
+{
+	switch (b->fmt) {
+	case OUT_CSV:
+		printf("device,id,xres,yres,bpp,line_length,test,bytes,reps,"
+		       "min_ns,mean_ns,p50_ns,p90_ns,p99_ns,max_ns,mb_s\n");
+		break;
+	case OUT_JSON:
+		printf("{\n  \"device\": \"%s\",\n  \"id\": \"%.16s\",\n"
+		       "  \"xres\": %u,\n  \"yres\": %u,\n  \"bpp\": %u,\n"
+		       "  \"line_length\": %u,\n  \"smem_len\": %u,\n"
+		       "  \"warmup\": %d,\n  \"results\": [", fb->node,
+		       fb->fix.id, fb->var.xres, fb->var.yres,
+		       fb->var.bits_per_pixel, fb->fix.line_length,
+		       fb->fix.smem_len, b->warmup);
+		break;
+	default:
+		printf("%s: %.16s %ux%u %ubpp line_length %u smem_len %u\n",
+		       fb->node, fb->fix.id, fb->var.xres, fb->var.yres,
+		       fb->var.bits_per_pixel, fb->fix.line_length,
+		       fb->fix.smem_len);
+		printf("%-26s %9s %5s %9s %9s %9s %9s %9s %9s %9s\n", "test",
+		       "bytes", "reps", "min_ns", "mean_ns", "p50_ns", "p90_ns",
+		       "p99_ns", "max_ns", "MB/s");
+		break;
+	}
+}
+
+static void print_footer(struct bench *b)
+{
+	if (b->fmt == OUT_JSON)
+		printf("\n  ]\n}\n");
+}
+
+static void print_result(struct fbdev *fb, struct bench *b, const char *name,
+                         long bytes)
+{
+	uint64_t *s = b->ns, sum = 0;
+	double mean, mbs;
+	int i, n = b->reps;
+
+	qsort(s, n, sizeof(*s), cmp_u64);
+	for (i = 0; i < n; i++)
+		sum += s[i];
+	mean = (double)sum / n;
+	mbs  = bytes && mean > 0 ? bytes / mean * 1e3 : 0.0;
+
+	switch (b->fmt) {
+	case OUT_CSV:
+		printf("%s,%.16s,%u,%u,%u,%u,%s,%ld,%d,%llu,%.0f,%llu,%llu,%llu,"
+		       "%llu,%.2f\n", fb->node, fb->fix.id, fb->var.xres,
+		       fb->var.yres, fb->var.bits_per_pixel, fb->fix.line_length,
+		       name, bytes, n, (unsigned long long)s[0], mean,
+		       (unsigned long long)percentile(s, n, 50),
+		       (unsigned long long)percentile(s, n, 90),
+		       (unsigned long long)percentile(s, n, 99),
+		       (unsigned long long)s[n - 1], mbs);
+		break;
+	case OUT_JSON:
+		printf("%s\n    { \"test\": \"%s\", \"bytes\": %ld, \"reps\": %d,"
+		       " \"min_ns\": %llu, \"mean_ns\": %.0f, \"p50_ns\": %llu,"
+		       " \"p90_ns\": %llu, \"p99_ns\": %llu, \"max_ns\": %llu,"
+		       " \"mb_s\": %.2f }", b->results ? "," : "", name, bytes, n,
+		       (unsigned long long)s[0], mean,
+		       (unsigned long long)percentile(s, n, 50),
+		       (unsigned long long)percentile(s, n, 90),
+		       (unsigned long long)percentile(s, n, 99),
+		       (unsigned long long)s[n - 1], mbs);
+		break;
+	default:
+		printf("%-26s %9ld %5d %9llu %9.0f %9llu %9llu %9llu %9llu %9.2f\n",
+		       name, bytes, n, (unsigned long long)s[0], mean,
+		       (unsigned long long)percentile(s, n, 50),
+		       (unsigned long long)percentile(s, n, 90),
+		       (unsigned long long)percentile(s, n, 99),
+		       (unsigned long long)s[n - 1], mbs);
+		break;
+	}
+	b->results++;
+}
+
+/* warm up, then time b->reps repetitions of a test and print them */
+static void run(struct fbdev *fb, struct bench *b, const char *name,
+                test_fn fn)
+{
+	uint64_t t0;
+	long bytes = 0;
+	int i;
+
+	for (i = 0; i < b->warmup; i++) {
+		if (fn(fb, b, i) < 0) {
+			dbg_warnx("%s not supported, skipped", name);
+			return;
+		}
+	}
+	for (i = 0; i < b->reps; i++) {
+		t0 = now_ns();
+		bytes = fn(fb, b, i);
+		b->ns[i] = now_ns() - t0;
+		if (bytes < 0) {
+			dbg_warnx("%s failed, skipped", name);
+			return;
+		}
+	}
+	print_result(fb, b, name, bytes);
+}
+
+/*--------------------------------------------------------------------------+
+ |  tests                                                                   |
+ +--------------------------------------------------------------------------*/
+static long t_write_full(struct fbdev *fb, struct bench *b, int rep)
+{
+	(void)b;
+	memset(fb->buf, rep, 64);
+	if (pwrite(fb->fd, fb->buf, fb->frame, 0) != (ssize_t)fb->frame)
+		return -1;
+	return fb->frame;
+}
+
+static long t_mmap_full(struct fbdev *fb, struct bench *b, int rep)
+{
+	(void)b;
+	memset(fb->buf, rep, 64);
+	memcpy(fb->mem, fb->buf, fb->frame);
+	return fb->frame;
+}
+
+static long t_read_full(struct fbdev *fb, struct bench *b, int rep)
+{
+	(void)b; (void)rep;
+	if (pread(fb->fd, fb->buf, fb->frame, 0) != (ssize_t)fb->frame)
+		return -1;
+	return fb->frame;
+}
+
+static long t_mmap_read(struct fbdev *fb, struct bench *b, int rep)
+{
+	(void)b; (void)rep;
+	memcpy(fb->buf, fb->mem, fb->frame);
+	return fb->frame;
+}
+
+/* offset of the rect of repetition rep, walks over the screen */
+static unsigned long rect_offs(struct fbdev *fb, struct bench *b, int rep)
+{
+	unsigned int bpp = (fb->var.bits_per_pixel + 7) / 8;
+	unsigned int cols = fb->var.xres / b->rect_w;
+	unsigned int rows = fb->var.yres / b->rect_h;
+	unsigned int n = rep % (cols * rows);
+
+	return (n / cols) * b->rect_h * fb->fix.line_length +
+	       (n % cols) * b->rect_w * bpp;
+}
+
+static long t_rect_mmap(struct fbdev *fb, struct bench *b, int rep)
+{
+	unsigned long offs = rect_offs(fb, b, rep);
+	unsigned int len = b->rect_w * ((fb->var.bits_per_pixel + 7) / 8);
+	unsigned int y;
+
+	for (y = 0; y < b->rect_h; y++, offs += fb->fix.line_length)
+		memset(fb->mem + offs, rep, len);
+	return (long)len * b->rect_h;
+}
+
+static long t_rect_write(struct fbdev *fb, struct bench *b, int rep)
+{
+	unsigned long offs = rect_offs(fb, b, rep);
+	unsigned int len = b->rect_w * ((fb->var.bits_per_pixel + 7) / 8);
+	unsigned int y;
+
+	memset(fb->buf, rep, len);
+	for (y = 0; y < b->rect_h; y++, offs += fb->fix.line_length)
+		if (pwrite(fb->fd, fb->buf, len, offs) != (ssize_t)len)
+			return -1;
+	return (long)len * b->rect_h;
+}
+
+/* FBIOPAN_DISPLAY between the first two screens (or to 0 if only one) */
+static long t_pan(struct fbdev *fb, struct bench *b, int rep)
+{
+	struct fb_var_screeninfo var = fb->var;
+
+	(void)b;
+	var.xoffset = 0;
+	var.yoffset = 0;
+	if ((rep & 1) && fb->var.yres_virtual >= 2 * fb->var.yres &&
+	    fb->fix.ypanstep)
+		var.yoffset = fb->var.yres;
+	return ioctl(fb->fd, FBIOPAN_DISPLAY, &var) ? -1 : 0;
+}
+
+/* 16z044 screen flip, screen 1 only if it fits into smem_len */
+static long t_set_screen(struct fbdev *fb, struct bench *b, int rep)
+{
+	unsigned int nr = (rep & 1) && fb->fix.smem_len >= 2 * fb->frame;
+
+	(void)b;
+	return ioctl(fb->fd, FBIO_MEN_16Z044_SET_SCREEN, &nr) ? -1 : 0;
+}
+
+/* ioctl round trips, pairs restore the state on odd repetitions */
+struct ioc_test {
+	const char *name;
+	unsigned long cmd;         /* even repetitions */
+	unsigned long cmd_odd;     /* odd repetitions, 0: same as cmd */
+	int visible;               /* changes the display, needs -a */
+};
+
+static const struct ioc_test ioc_tests[] = {
+	{ "FBIOGET_VSCREENINFO", FBIOGET_VSCREENINFO, 0, 0 },
+	{ "FBIOGET_FSCREENINFO", FBIOGET_FSCREENINFO, 0, 0 },
+	{ "FBIO_*_16Z044_TEST", FBIO_ENABLE_MEN_16Z044_TEST,
+	  FBIO_DISABLE_MEN_16Z044_TEST, 1 },
+	{ "FBIO_ENABLE_75HZ/60HZ", FBIO_ENABLE_75HZ, FBIO_ENABLE_60HZ, 1 },
+	{ "FBIO_MEN_16Z044_(UN)BLANK", FBIO_MEN_16Z044_BLANK,
+	  FBIO_MEN_16Z044_UNBLANK, 1 },
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	{ "FBIO_MEN_16Z044_SWAP_*", FBIO_MEN_16Z044_SWAP_OFF,
+	  FBIO_MEN_16Z044_SWAP_ON, 1 },
+#else
+	{ "FBIO_MEN_16Z044_SWAP_*", FBIO_MEN_16Z044_SWAP_ON,
+	  FBIO_MEN_16Z044_SWAP_OFF, 1 },
+#endif
+};
+
+static const struct ioc_test *cur_ioc;
+
+static long t_ioctl(struct fbdev *fb, struct bench *b, int rep)
+{
+	struct fb_var_screeninfo var;
+	struct fb_fix_screeninfo fix;
+	unsigned long cmd = cur_ioc->cmd;
+	void *arg = NULL;
+
+	(void)b;
+	if ((rep & 1) && cur_ioc->cmd_odd)
+		cmd = cur_ioc->cmd_odd;
+	if (cmd == FBIOGET_VSCREENINFO)
+		arg = &var;
+	else if (cmd == FBIOGET_FSCREENINFO)
+		arg = &fix;
+	return ioctl(fb->fd, cmd, arg) ? -1 : 0;
+}
+
+/*--------------------------------------------------------------------------+
+ |  main                                                                    |
+ +--------------------------------------------------------------------------*/
+static void usage(char *argv0)
+{
+	printf("Usage: %s [options]\n", argv0);
+	printf("  -d <device>  Framebuffer device (default /dev/fb0)\n");
+	printf("  -n <reps>    Repetitions per test (default 100)\n");
+	printf("  -w <count>   Warm-up repetitions (default 10)\n");
+	printf("  -r <w>x<h>   Rect of the partial update tests (default 64x64)\n");
+	printf("  -t <tests>   Comma separated list of: write,mmap,rect,pan,"
+	       "ioctl,read\n               (default all)\n");
+	printf("  -a           Also time ioctls that change the display\n"
+	       "               (test pattern, refresh, blank, byte swap)\n");
+	printf("  -o <format>  text, csv or json (default text)\n");
+	printf("  -v           Verbose output\n");
+	exit(1);
+}
+
+static int selected(const char *tests, const char *name)
+{
+	const char *p = tests;
+	size_t len = strlen(name);
+
+	if (!tests)
+		return 1;
+	while ((p = strstr(p, name))) {
+		if ((p == tests || p[-1] == ',') && (!p[len] || p[len] == ','))
+			return 1;
+		p += len;
+	}
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	struct fbdev fb;
+	struct bench b;
+	char *tests = NULL;
+	unsigned int i;
+
+	extern char *optarg;
+	extern int optind;
+	int opt;
+
+	memset(&fb, 0, sizeof(fb));
+	memset(&b, 0, sizeof(b));
+	fb.node  = "/dev/fb0";
+	b.reps   = 100;
+	b.warmup = 10;
+	b.rect_w = 64;
+	b.rect_h = 64;
+
+	while ((opt = getopt(argc, argv, "ad:hn:o:r:t:vw:")) != -1) {
+		switch (opt) {
+		case 'a':
+			b.all_ioctls = 1;
+			break;
+		case 'd':
+			fb.node = optarg;
+			break;
+		case 'n':
+			b.reps = atoi(optarg);
+			break;
+		case 'o':
+			if (!strcmp(optarg, "csv"))
+				b.fmt = OUT_CSV;
+			else if (!strcmp(optarg, "json"))
+				b.fmt = OUT_JSON;
+			else if (strcmp(optarg, "text"))
+				usage(argv[0]);
+			break;
+		case 'r':
+			if (sscanf(optarg, "%ux%u", &b.rect_w, &b.rect_h) != 2)
+				usage(argv[0]);
+			break;
+		case 't':
+			tests = optarg;
+			break;
+		case 'v':
+			dbg = 1;
+			break;
+		case 'w':
+			b.warmup = atoi(optarg);
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+	if (optind != argc || b.reps < 1 || b.warmup < 0)
+		usage(argv[0]);
+
+	fb.fd = open(fb.node, O_RDWR);
+	if (fb.fd == -1)
+		err(1, "Cannot open framebuffer device %s", fb.node);
+	if (ioctl(fb.fd, FBIOGET_FSCREENINFO, &fb.fix))
+		err(1, "Error reading fixed screen information");
+	if (ioctl(fb.fd, FBIOGET_VSCREENINFO, &fb.var))
+		err(1, "Error reading variable screen information");
+
+	fb.frame = (unsigned long)fb.fix.line_length * fb.var.yres;
+	if (fb.frame > fb.fix.smem_len)
+		fb.frame = fb.fix.smem_len;
+	if (!b.rect_w || !b.rect_h || b.rect_w > fb.var.xres ||
+	    b.rect_h > fb.var.yres)
+		errx(1, "Rect %ux%u does not fit into %ux%u", b.rect_w,
+		     b.rect_h, fb.var.xres, fb.var.yres);
+
+	fb.mem = mmap(0, fb.fix.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED,
+	              fb.fd, 0);
+	if (fb.mem == MAP_FAILED)
+		err(1, "Failed to map framebuffer to memory");
+	fb.buf   = malloc(fb.frame);
+	fb.saved = malloc(fb.frame);
+	b.ns     = malloc(b.reps * sizeof(*b.ns));
+	if (!fb.buf || !fb.saved || !b.ns)
+		err(1, "Cannot allocate buffers");
+	memset(fb.buf, 0, fb.frame);
+	memcpy(fb.saved, fb.mem, fb.frame);
+
+	print_header(&fb, &b);
+	if (selected(tests, "write"))
+		run(&fb, &b, "write_full", t_write_full);
+	if (selected(tests, "mmap"))
+		run(&fb, &b, "mmap_full", t_mmap_full);
+	if (selected(tests, "rect")) {
+		run(&fb, &b, "rect_mmap", t_rect_mmap);
+		run(&fb, &b, "rect_write", t_rect_write);
+	}
+	if (selected(tests, "pan")) {
+		run(&fb, &b, "pan_display", t_pan);
+		run(&fb, &b, "flip_set_screen", t_set_screen);
+	}
+	if (selected(tests, "ioctl")) {
+		for (i = 0; i < sizeof(ioc_tests) / sizeof(ioc_tests[0]); i++) {
+			cur_ioc = &ioc_tests[i];
+			if (cur_ioc->visible && !b.all_ioctls)
+				continue;
+			run(&fb, &b, cur_ioc->name, t_ioctl);
+			/* odd -n/-w end on an even repetition */
+			if (cur_ioc->cmd_odd)
+				ioctl(fb.fd, cur_ioc->cmd_odd, NULL);
+		}
+	}
+	if (selected(tests, "read")) {
+		run(&fb, &b, "read_full", t_read_full);
+		run(&fb, &b, "mmap_read", t_mmap_read);
+	}
+	print_footer(&b);
+
+	/* back to screen 0 with the old content */
+	i = 0;
+	ioctl(fb.fd, FBIO_MEN_16Z044_SET_SCREEN, &i);
+	fb.var.xoffset = fb.var.yoffset = 0;
+	ioctl(fb.fd, FBIOPAN_DISPLAY, &fb.var);
+	memcpy(fb.mem, fb.saved, fb.frame);
+
+	munmap(fb.mem, fb.fix.smem_len);
+	close(fb.fd);
+	free(fb.buf);
+	free(fb.saved);
+	free(b.ns);
+	return 0;
+}
@@ -0,0 +1,414 @@
+/*****************************************************************************
+ * Bandwidth and integrity test of the frame buffer memory
+ *
+ * Maps the whole smem_len of a framebuffer device and runs
+ *  - sequential and strided write/read bandwidth tests per access width
+ *  - march C- and address-in-address integrity tests
+ * over the off-screen memory behind the visible screen. With -V the
+ * visible screen is tested too while the display is blanked with
+ * FBIO_MEN_16Z044_BLANK, its content is restored afterwards.
+ * The off-screen test starts at the surface base of the sysfs vram file,
+ * so the coalesce= and vt_screens= screens are kept. It overwrites all
+ * surfaces and refuses to run while there are any, unless -f is given.
+ * Slow SDRAM, PCI link problems and software issues can so be told apart
+ * on a unit in the field. The exit code is 1 if a memory error was found.
+ *
+ * Note: with shadow=1 the driver maps its RAM shadow, load it without
+ * shadow to test the SDRAM.
+ *
+ * Copyright 2020, MEN Mikro Elektronik GmbH
+ ****************************************************************************/
+
+ /*
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+#include <err.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <linux/fb.h>
+#include "../../../../INCLUDE/NATIVE/MEN/fb_men_16z044.h"
+
+int dbg = 0;
+#define dbg_warnx(format, ...) do {               \
+	if (dbg)                                  \
+		warnx(format, ##  __VA_ARGS__ );  \
+	} while(0)
+
+#define PAGE_SZ         4096UL
+
+/* memory region under test */
+struct region {
+	const char *name;
+	volatile unsigned char *mem;
+	unsigned long offs;          /* offset in smem, for reports */
+	unsigned long size;
+};
+
+static unsigned long max_errors = 16;
+static unsigned long errors;
+static volatile uint64_t sink;
+
+static double now_s(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/*--------------------------------------------------------------------------+
+ |  bandwidth                                                               |
+ +--------------------------------------------------------------------------*/
+/* one pass over the region, width in bytes, stride 0 is sequential */
+#define BW_PASS(type, r, width, stride, write) do {                         \
+	volatile type *p;                                                   \
+	unsigned long i, s, step = (stride) ? (stride) : (width);           \
+	unsigned long starts = (stride) ? (stride) / (width) : 1;           \
+	type acc = 0;                                                       \
+	for (s = 0; s < starts; s++) {                                      \
+		for (i = s * (width); i + (width) <= (r)->size; i += step) { \
+			p = (volatile type *)((r)->mem + i);                \
+			if (write)                                          \
+				*p = (type)i;                               \
+			else                                                \
+				acc += *p;                                  \
+		}                                                           \
+	}                                                                   \
+	sink += acc;                                                        \
+} while (0)
+
+static void bw_pass(struct region *r, int width, unsigned long stride,
+                    int write)
+{
+	switch (width) {
+	case 1: BW_PASS(uint8_t,  r, 1, stride, write); break;
+	case 2: BW_PASS(uint16_t, r, 2, stride, write); break;
+	case 4: BW_PASS(uint32_t, r, 4, stride, write); break;
+	case 8: BW_PASS(uint64_t, r, 8, stride, write); break;
+	}
+}
+
+/* best of loops passes, MB/s */
+static double bw_test(struct region *r, int width, unsigned long stride,
+                      int write, int loops)
+{
+	double t0, t, best = 0;
+	int l;
+
+	for (l = 0; l < loops; l++) {
+		t0 = now_s();
+		bw_pass(r, width, stride, write);
+		if (write)
+			__sync_synchronize();
+		t = now_s() - t0;
+		if (!l || t < best)
+			best = t;
+	}
+	return best > 0 ? r->size / best / 1e6 : 0.0;
+}
+
+static void bandwidth(struct region *r, unsigned long stride, int loops)
+{
+	static const int widths[] = { 1, 2, 4, 8 };
+	unsigned int w;
+
+	printf("\n%s: bandwidth over %lu bytes at 0x%08lx, best of %d [MB/s]\n",
+	       r->name, r->size, r->offs, loops);
+	printf("  %-6s %10s %10s %10s %10s\n", "width", "seq wr", "seq rd",
+	       "stride wr", "stride rd");
+	for (w = 0; w < sizeof(widths) / sizeof(widths[0]); w++) {
+		if (sizeof(long) < (size_t)widths[w])
+			continue;
+		printf("  %2d bit %10.2f %10.2f %10.2f %10.2f\n", widths[w] * 8,
+		       bw_test(r, widths[w], 0, 1, loops),
+		       bw_test(r, widths[w], 0, 0, loops),
+		       bw_test(r, widths[w], stride, 1, loops),
+		       bw_test(r, widths[w], stride, 0, loops));
+	}
+}
+
+/*--------------------------------------------------------------------------+
+ |  integrity                                                               |
+ +--------------------------------------------------------------------------*/
+static void report(struct region *r, unsigned long i, uint32_t expect,
+                   uint32_t got, const char *test)
+{
+	errors++;
+	if (errors <= max_errors)
+		printf("  FAIL %-10s addr 0x%08lx expected 0x%08x got 0x%08x "
+		       "xor 0x%08x\n", test, r->offs + i * 4, expect, got,
+		       expect ^ got);
+	else if (errors == max_errors + 1)
+		printf("  ... more errors not shown\n");
+}
+
+/* march element: read expect (if rd), then write val, up or down */
+static void march_elem(struct region *r, int up, int rd, uint32_t expect,
+                       int wr, uint32_t val, const char *test)
+{
+	volatile uint32_t *m = (volatile uint32_t *)r->mem;
+	unsigned long n = r->size / 4, k, i;
+	uint32_t got;
+
+	for (k = 0; k < n; k++) {
+		i = up ? k : n - 1 - k;
+		if (rd) {
+			got = m[i];
+			if (got != expect)
+				report(r, i, expect, got, test);
+		}
+		if (wr)
+			m[i] = val;
+	}
+}
+
+/* march C-: up(w0) up(r0,w1) up(r1,w0) down(r0,w1) down(r1,w0) up(r0) */
+static void march_c(struct region *r, uint32_t bg, const char *test)
+{
+	uint32_t inv = ~bg;
+
+	march_elem(r, 1, 0, 0,   1, bg,  test);
+	march_elem(r, 1, 1, bg,  1, inv, test);
+	march_elem(r, 1, 1, inv, 1, bg,  test);
+	march_elem(r, 0, 1, bg,  1, inv, test);
+	march_elem(r, 0, 1, inv, 1, bg,  test);
+	march_elem(r, 1, 1, bg,  0, 0,   test);
+}
+
+/* every word holds its own offset, finds address line faults */
+static void addr_in_addr(struct region *r)
+{
+	volatile uint32_t *m = (volatile uint32_t *)r->mem;
+	unsigned long n = r->size / 4, i;
+	uint32_t got;
+	int inv;
+
+	for (inv = 0; inv < 2; inv++) {
+		for (i = 0; i < n; i++)
+			m[i] = (uint32_t)(r->offs + i * 4) ^ (inv ? ~0u : 0);
+		for (i = 0; i < n; i++) {
+			got = m[i];
+			if (got != ((uint32_t)(r->offs + i * 4) ^ (inv ? ~0u : 0)))
+				report(r, i, (uint32_t)(r->offs + i * 4) ^
+				       (inv ? ~0u : 0), got, "addr");
+		}
+	}
+}
+
+static void integrity(struct region *r)
+{
+	unsigned long before = errors;
+	double t0 = now_s();
+
+	printf("\n%s: integrity over %lu bytes at 0x%08lx\n", r->name, r->size,
+	       r->offs);
+	march_c(r, 0x00000000, "march 0");
+	march_c(r, 0x55555555, "march 5");
+	march_c(r, 0x33333333, "march 3");
+	march_c(r, 0x0f0f0f0f, "march 0f");
+	addr_in_addr(r);
+	printf("  %lu errors, %.2f s\n", errors - before, now_s() - t0);
+}
+
+/*--------------------------------------------------------------------------+
+ |  main                                                                    |
+ +--------------------------------------------------------------------------*/
+/* surface base and count from the sysfs vram file, 0 if there is none */
+static int vram_info(int fd, unsigned long *base, unsigned int *surfaces)
+{
+	struct stat st;
+	char path[64];
+	FILE *f;
+	int n;
+
+	if (fstat(fd, &st) || !S_ISCHR(st.st_mode))
+		return 0;
+	snprintf(path, sizeof(path), "/sys/class/graphics/fb%u/vram",
+	         minor(st.st_rdev));
+	f = fopen(path, "r");
+	if (!f)
+		return 0;
+	n = fscanf(f, "base 0x%lx size %*u free %*u largest %*u surfaces %u",
+	           base, surfaces);
+	fclose(f);
+	return n == 2;
+}
+
+static void usage(char *argv0)
+{
+	printf("Usage: %s [options]\n", argv0);
+	printf("  -d <device>  Framebuffer device (default /dev/fb0)\n");
+	printf("  -b           Bandwidth tests only\n");
+	printf("  -i           Integrity tests only\n");
+	printf("  -V           Also test the visible screen, display is blanked\n");
+	printf("  -f           Run even though surfaces exist, destroys them\n");
+	printf("  -n <loops>   Bandwidth passes, best is reported (default 3)\n");
+	printf("  -s <bytes>   Stride of the strided tests (default line_length)\n");
+	printf("  -e <count>   Failing addresses to print (default 16)\n");
+	printf("  -v           Verbose output\n");
+	exit(1);
+}
+
+int main(int argc, char **argv)
+{
+	struct fb_fix_screeninfo fix;
+	struct fb_var_screeninfo var;
+	struct region reg[2];
+	unsigned char *mem, *saved = NULL;
+	unsigned long frame, off_start, stride = 0, vram_base;
+	unsigned int surfaces;
+	char *dev_node = "/dev/fb0";
+	int do_bw = 1, do_int = 1, visible = 0, loops = 3, blanked = 0;
+	int force = 0;
+	int fd, nreg = 0, i;
+
+	extern char *optarg;
+	extern int optind;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "bd:e:fhin:s:vV")) != -1) {
+		switch (opt) {
+		case 'b':
+			do_int = 0;
+			break;
+		case 'd':
+			dev_node = optarg;
+			break;
+		case 'e':
+			max_errors = strtoul(optarg, NULL, 0);
+			break;
+		case 'f':
+			force = 1;
+			break;
+		case 'i':
+			do_bw = 0;
+			break;
+		case 'n':
+			loops = atoi(optarg);
+			break;
+		case 's':
+			stride = strtoul(optarg, NULL, 0);
+			break;
+		case 'v':
+			dbg = 1;
+			break;
+		case 'V':
+			visible = 1;
+			break;
+		case 'h':
+		default:
+			usage(argv[0]);
+			break;
+		}
+	}
+	if (optind != argc || loops < 1 || (!do_bw && !do_int))
+		usage(argv[0]);
+
+	fd = open(dev_node, O_RDWR);
+	if (fd == -1)
+		err(1, "Cannot open framebuffer device %s", dev_node);
+	if (ioctl(fd, FBIOGET_FSCREENINFO, &fix))
+		err(1, "Error reading fixed screen information");
+	if (ioctl(fd, FBIOGET_VSCREENINFO, &var))
+		err(1, "Error reading variable screen information");
+
+	mem = mmap(0, fix.smem_len, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mem == MAP_FAILED)
+		err(1, "Failed to map framebuffer to memory");
+
+	frame = (unsigned long)fix.line_length * var.yres;
+	if (frame > fix.smem_len)
+		frame = fix.smem_len;
+	off_start = frame;
+	if (vram_info(fd, &vram_base, &surfaces)) {
+		dbg_warnx("surface base 0x%lx, %u surfaces", vram_base,
+		          surfaces);
+		if (surfaces && !force)
+			errx(1, "%u surfaces in use, the test overwrites them "
+			     "(-f to run anyway)", surfaces);
+		if (vram_base > off_start)
+			off_start = vram_base;
+	}
+	off_start = (off_start + PAGE_SZ - 1) & ~(PAGE_SZ - 1);
+	if (!stride)
+		stride = fix.line_length;
+	stride &= ~7UL;
+	if (!stride)
+		stride = 64;
+
+	printf("%s: %.16s %ux%u %ubpp smem_len %u (0x%08lx visible, "
+	       "0x%08lx off-screen)\n", dev_node, fix.id, var.xres, var.yres,
+	       var.bits_per_pixel, fix.smem_len, frame,
+	       off_start < fix.smem_len ? fix.smem_len - off_start : 0);
+
+	if (off_start < fix.smem_len) {
+		reg[nreg].name = "off-screen";
+		reg[nreg].mem  = mem + off_start;
+		reg[nreg].offs = off_start;
+		reg[nreg].size = (fix.smem_len - off_start) & ~7UL;
+		nreg++;
+	} else {
+		warnx("no off-screen memory (driver loaded with shadow=1?)");
+	}
+	if (visible) {
+		saved = malloc(frame);
+		if (!saved)
+			err(1, "Cannot allocate %lu bytes", frame);
+		memcpy(saved, mem, frame);
+		if (ioctl(fd, FBIO_MEN_16Z044_BLANK))
+			warnx("cannot blank %s, testing visible", dev_node);
+		else
+			blanked = 1;
+		reg[nreg].name = "visible";
+		reg[nreg].mem  = mem;
+		reg[nreg].offs = 0;
+		reg[nreg].size = frame & ~7UL;
+		nreg++;
+	}
+	if (!nreg)
+		errx(1, "nothing to test, try -V");
+
+	for (i = 0; i < nreg; i++) {
+		dbg_warnx("%s %p size 0x%lx stride %lu", reg[i].name,
+		          (void *)reg[i].mem, reg[i].size, stride);
+		if (do_bw)
+			bandwidth(&reg[i], stride, loops);
+		if (do_int)
+			integrity(&reg[i]);
+	}
+
+	if (saved) {
+		memcpy(mem, saved, frame);
+		if (blanked && ioctl(fd, FBIO_MEN_16Z044_UNBLANK))
+			warn("cannot unblank %s", dev_node);
+		free(saved);
+	}
+	munmap(mem, fix.smem_len);
+	close(fd);
+
+	if (do_int)
+		printf("\n%s: %lu memory errors\n", errors ? "FAILED" : "PASSED",
+		       errors);
+	return errors ? 1 : 0;
+}
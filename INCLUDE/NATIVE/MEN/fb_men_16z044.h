@@ -34,6 +34,7 @@
 #define _MEN_16Z044_FB_
 
 #include <linux/version.h>	
+#include <linux/types.h>
 
 /* -- MEN 16Z044 Framebuffer,  additional ioctls -- */
 #define MEN_16Z044_IOC_MAGIC		'F'
@@ -46,7 +47,15 @@
         _IO(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 	2 )
 #define FBIO_ENABLE_60HZ\
         _IO(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 	3 )
-/* offs.  4-7 intentionally left free for Resolution changing */
+/* resolution changing, needs driver parameter modeswitch=1 */
+#define FBIO_MEN_16Z044_RES_640X480\
+		_IO(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 	4 )
+#define FBIO_MEN_16Z044_RES_800X600\
+		_IO(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 	5 )
+#define FBIO_MEN_16Z044_RES_1024X768\
+		_IO(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 	6 )
+#define FBIO_MEN_16Z044_RES_1280X1024\
+		_IO(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 	7 )
 #define FBIO_MEN_16Z044_BLANK\
 		_IO(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 	8 )
 #define FBIO_MEN_16Z044_UNBLANK\
@@ -59,4 +68,92 @@
 #define FBIO_MEN_16Z044_SET_SCREEN\
     _IOW( MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 12 , unsigned int)
 
+/* -- off-screen SDRAM surfaces, pixels in the SDRAM format (RGB565) -- */
+/* handles are valid for the allocating process only, its surfaces are
+ * freed after it exited or when the last client closes the device */
+struct men_16z044_surface {
+	__u32 handle;			/* out of SURF_ALLOC */
+	__u32 width;			/* pixels */
+	__u32 height;
+	__u32 offset;			/* out: SDRAM byte offset */
+	__u32 pitch;			/* out: bytes per line */
+};
+
+/* write pixels from user memory into a rect of a surface */
+struct men_16z044_surf_upload {
+	__u32 handle;
+	__u32 x;				/* rect in the surface */
+	__u32 y;
+	__u32 width;
+	__u32 height;
+	__u32 pitch;			/* bytes per line of data */
+	__u64 data;				/* user address of the pixels */
+};
+
+/* copy a rect of a surface to the screen */
+struct men_16z044_surf_blit {
+	__u32 handle;
+	__u32 sx;				/* rect in the surface */
+	__u32 sy;
+	__u32 dx;				/* position on the screen */
+	__u32 dy;
+	__u32 width;
+	__u32 height;
+};
+
+#define FBIO_MEN_16Z044_SURF_ALLOC\
+    _IOWR(MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 13, struct men_16z044_surface)
+#define FBIO_MEN_16Z044_SURF_FREE\
+    _IOW( MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 14, unsigned int)
+#define FBIO_MEN_16Z044_SURF_UPLOAD\
+    _IOW( MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 15, struct men_16z044_surf_upload)
+#define FBIO_MEN_16Z044_SURF_BLIT\
+    _IOW( MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 16, struct men_16z044_surf_blit)
+
+/* -- animation, screen sized surfaces shown in turn by frame offset -- */
+#define MEN_16Z044_ANIM_MAX		1024	/* frames */
+
+struct men_16z044_anim {
+	__u32 interval_ms;		/* time each frame is shown */
+	__u32 count;			/* number of frames */
+	__u64 handles;			/* user address of count surface handles */
+};
+
+#define FBIO_MEN_16Z044_ANIM_START\
+    _IOW( MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 17, struct men_16z044_anim)
+#define FBIO_MEN_16Z044_ANIM_STOP\
+    _IO(  MEN_16Z044_IOC_MAGIC, MEN_16Z044_IOCBASE + 18 )
+
+/* -- access capture, read from debugfs fb16z044_<n>/capture -- */
+#define MEN_16Z044_CAP_MAGIC		0x5A343443	/* 'Z44C' */
+#define MEN_16Z044_CAP_VERSION		1
+
+/* capture starts with this header, followed by records */
+struct men_16z044_cap_hdr {
+	__u32 magic;
+	__u32 version;
+	__u32 xres;
+	__u32 yres;
+	__u32 line_length;		/* bytes per line in SDRAM */
+	__u32 bytes_per_pixel;
+	__u32 sdram_size;
+	__u32 lost;				/* records overwritten before read */
+};
+
+/* record types */
+#define MEN_16Z044_CAP_REG_RD		1	/* offs: register, val: value */
+#define MEN_16Z044_CAP_REG_WR		2	/* offs: register, val: value */
+#define MEN_16Z044_CAP_FOFFS		3	/* val: frame offset */
+#define MEN_16Z044_CAP_SDRAM_WR		4	/* rows * val bytes at offs */
+#define MEN_16Z044_CAP_SDRAM_RD		5	/* rows * val bytes at offs */
+
+/* one access, SDRAM ranges of several rows use a stride of line_length */
+struct men_16z044_cap_rec {
+	__u64 ns;				/* monotonic time stamp */
+	__u32 type;
+	__u32 offs;
+	__u32 val;
+	__u32 rows;
+};
+
 #endif